@@ -0,0 +1,444 @@
+/*
+ * Token diff engines, see diff.h
+ */
+
+#include "diff.h"
+#include "workspace.h"
+
+using namespace std;
+
+// tokens occurring more often than this in a part are not anchored on
+#define HISTOGRAM_MAX_COUNT 64
+
+// a part of the sequences still to be diffed, a[a_begin, a_end) against
+// b[b_begin, b_end)
+typedef struct {
+    size_t a_begin;
+    size_t a_end;
+    size_t b_begin;
+    size_t b_end;
+} diffPart;
+
+// the buffers of the diff engines, one per thread, see workspace.h
+typedef struct {
+    dtl::Diff< uint32_t, vector<uint32_t> > onp;
+    vector<uint32_t> part_a; // a part diffed by O(NP)
+    vector<uint32_t> part_b;
+
+    // with DIFF_HISTOGRAM, the parts left to diff, the last one first
+    vector<diffPart> parts;
+    // for each id, its occurrences in the a side of the part being anchored
+    // and the last of them plus one, which chains to the ones before it
+    // through previous
+    vector<uint32_t> counts;
+    vector<size_t> last;
+    vector<size_t> previous;
+
+    // with DIFF_LINEAR, the furthest reaching paths from the start and the
+    // end of the part being split on each diagonal
+    vector<long long> forward;
+    vector<long long> backward;
+} engineWorkspace;
+
+static bool
+diff_onp(engineWorkspace *workspace, const vector<uint32_t>& a, const vector<uint32_t>& b,
+         long long budget, diffVisitor *visitor)
+{
+    dtl::Diff< uint32_t, vector<uint32_t> >& d = workspace->onp;
+    d.reset(a, b);
+    d.onOnlyChanges();
+    d.setMaxEditDistance(budget);
+    d.setSesVisitor(visitor);
+    d.compose();
+    return !d.isAbandoned();
+}
+
+// passes edits on to another visitor with the indices of a part of the
+// sequences made indices in the whole of them, counting them
+class offsetVisitor : public diffVisitor {
+public:
+    diffVisitor *visitor;
+    size_t a_offset;
+    size_t b_offset;
+    long long edits;
+
+    void operator() (const uint32_t& id, const dtl::elemInfo& info) {
+        dtl::elemInfo whole = info;
+        whole.beforeIdx += (info.type == dtl::SES_ADD) ? b_offset : a_offset;
+        (*visitor)(id, whole);
+        ++edits;
+    }
+};
+
+/* passes s[begin, end) to the visitor as edits of the given type */
+static void
+visit_range(diffVisitor *visitor, const vector<uint32_t>& s, size_t begin, size_t end,
+            dtl::edit_t type)
+{
+    dtl::elemInfo info;
+    info.afterIdx = 0;
+    info.type = type;
+    for (size_t i = begin; i < end; ++i) {
+        info.beforeIdx = i + 1;
+        (*visitor)(s[i], info);
+    }
+}
+
+/* one more than the largest id in a and b */
+static uint32_t
+id_limit(const vector<uint32_t>& a, const vector<uint32_t>& b)
+{
+    uint32_t ids = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        ids = max(ids, a[i] + 1);
+    }
+    for (size_t j = 0; j < b.size(); ++j) {
+        ids = max(ids, b[j] + 1);
+    }
+    return ids;
+}
+
+static bool
+diff_histogram(engineWorkspace *workspace, const vector<uint32_t>& a, const vector<uint32_t>& b,
+               long long budget, diffVisitor *visitor)
+{
+    uint32_t ids = id_limit(a, b);
+    vector<uint32_t>& counts = workspace->counts;
+    vector<size_t>& last = workspace->last;
+    vector<size_t>& previous = workspace->previous;
+    counts.assign(ids, 0);
+    last.assign(ids, 0);
+    previous.resize(a.size());
+
+    vector<diffPart>& parts = workspace->parts;
+    parts.clear();
+    diffPart whole = { 0, a.size(), 0, b.size() };
+    parts.push_back(whole);
+
+    // the budget bounds the edits of all the parts together
+    long long edits = 0;
+
+    while (!parts.empty()) {
+        diffPart p = parts.back();
+        parts.pop_back();
+
+        while (p.a_begin < p.a_end && p.b_begin < p.b_end && a[p.a_begin] == b[p.b_begin]) {
+            ++p.a_begin;
+            ++p.b_begin;
+        }
+        while (p.a_begin < p.a_end && p.b_begin < p.b_end && a[p.a_end - 1] == b[p.b_end - 1]) {
+            --p.a_end;
+            --p.b_end;
+        }
+        if (p.a_begin == p.a_end || p.b_begin == p.b_end) {
+            edits += (p.a_end - p.a_begin) + (p.b_end - p.b_begin);
+            if (budget > 0 && edits > budget) {
+                return false;
+            }
+            visit_range(visitor, a, p.a_begin, p.a_end, dtl::SES_DELETE);
+            visit_range(visitor, b, p.b_begin, p.b_end, dtl::SES_ADD);
+            continue;
+        }
+
+        for (size_t i = p.a_begin; i < p.a_end; ++i) {
+            ++counts[a[i]];
+            previous[i] = last[a[i]];
+            last[a[i]] = i + 1;
+        }
+
+        // the run of common tokens with the rarest least frequent token, the
+        // longest of those
+        bool common = false;
+        uint32_t best_count = HISTOGRAM_MAX_COUNT;
+        size_t best_a = 0, best_b = 0, best_length = 0;
+        for (size_t j = p.b_begin; j < p.b_end; ) {
+            uint32_t id = b[j];
+            size_t next = j + 1;
+            common = common || counts[id] != 0;
+            if (counts[id] != 0 && counts[id] <= best_count) {
+                for (size_t occurrence = last[id]; occurrence != 0; occurrence = previous[occurrence - 1]) {
+                    size_t start_a = occurrence - 1, start_b = j;
+                    size_t end_a = start_a + 1, end_b = j + 1;
+                    uint32_t run_count = counts[id];
+                    while (start_a > p.a_begin && start_b > p.b_begin && a[start_a - 1] == b[start_b - 1]) {
+                        --start_a;
+                        --start_b;
+                        run_count = min(run_count, counts[a[start_a]]);
+                    }
+                    while (end_a < p.a_end && end_b < p.b_end && a[end_a] == b[end_b]) {
+                        run_count = min(run_count, counts[a[end_a]]);
+                        ++end_a;
+                        ++end_b;
+                    }
+                    if (run_count < best_count
+                            || (run_count == best_count && end_a - start_a > best_length)) {
+                        best_count = run_count;
+                        best_a = start_a;
+                        best_b = start_b;
+                        best_length = end_a - start_a;
+                    }
+                    next = max(next, end_b);
+                }
+            }
+            j = next;
+        }
+
+        for (size_t i = p.a_begin; i < p.a_end; ++i) {
+            counts[a[i]] = 0;
+            last[a[i]] = 0;
+        }
+
+        if (best_length > 0) {
+            // the part after the anchor is diffed after the one before it
+            diffPart after = { best_a + best_length, p.a_end, best_b + best_length, p.b_end };
+            diffPart before = { p.a_begin, best_a, p.b_begin, best_b };
+            parts.push_back(after);
+            parts.push_back(before);
+        } else if (!common) {
+            edits += (p.a_end - p.a_begin) + (p.b_end - p.b_begin);
+            if (budget > 0 && edits > budget) {
+                return false;
+            }
+            visit_range(visitor, a, p.a_begin, p.a_end, dtl::SES_DELETE);
+            visit_range(visitor, b, p.b_begin, p.b_end, dtl::SES_ADD);
+        } else {
+            // every common token is too frequent to be a useful anchor
+            workspace->part_a.assign(a.begin() + p.a_begin, a.begin() + p.a_end);
+            workspace->part_b.assign(b.begin() + p.b_begin, b.begin() + p.b_end);
+            offsetVisitor part_visitor;
+            part_visitor.visitor = visitor;
+            part_visitor.a_offset = p.a_begin;
+            part_visitor.b_offset = p.b_begin;
+            part_visitor.edits = 0;
+            // the part differs, so a spent budget cannot cover it, and
+            // passing on what is left as 0 would lift the limit
+            if (budget > 0 && edits >= budget) {
+                return false;
+            }
+            if (!diff_onp(workspace, workspace->part_a, workspace->part_b,
+                          budget > 0 ? budget - edits : 0, &part_visitor)) {
+                return false;
+            }
+            edits += part_visitor.edits;
+        }
+    }
+    return true;
+}
+
+/* Finds a point on a shortest path between a[0, n) and b[0, m), which have
+ * no common prefix or suffix, by extending paths from both ends a difference
+ * at a time until they overlap (Myers' middle snake).  Returns false if
+ * there is no such point but the ends, or, setting *abandoned, if the paths
+ * have not met within budget differences.
+ */
+static bool
+middle_snake(engineWorkspace *workspace, const uint32_t *a, long long n, const uint32_t *b,
+             long long m, long long budget, long long *x, long long *y, bool *abandoned)
+{
+    long long max_d = (n + m + 1) / 2;
+    long long offset = max_d;
+    long long length = 2 * max_d;
+    vector<long long>& v1 = workspace->forward;
+    vector<long long>& v2 = workspace->backward;
+    v1.assign(length, -1);
+    v2.assign(length, -1);
+    v1[offset + 1] = 0;
+    v2[offset + 1] = 0;
+    long long delta = n - m;
+    // the paths meet going forwards if the difference in lengths is odd
+    bool front = (delta % 2 != 0);
+    // diagonals which have run off the edit graph are no longer extended
+    long long k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+
+    for (long long d = 0; d < max_d; ++d) {
+        if (budget > 0 && 2 * d > budget) {
+            *abandoned = true;
+            return false;
+        }
+        for (long long k1 = -d + k1start; k1 <= d - k1end; k1 += 2) {
+            long long k1_offset = offset + k1;
+            long long x1;
+            if (k1 == -d || (k1 != d && v1[k1_offset - 1] < v1[k1_offset + 1])) {
+                x1 = v1[k1_offset + 1];
+            } else {
+                x1 = v1[k1_offset - 1] + 1;
+            }
+            long long y1 = x1 - k1;
+            while (x1 < n && y1 < m && a[x1] == b[y1]) {
+                ++x1;
+                ++y1;
+            }
+            v1[k1_offset] = x1;
+            if (x1 > n) {
+                k1end += 2;
+            } else if (y1 > m) {
+                k1start += 2;
+            } else if (front) {
+                long long k2_offset = offset + delta - k1;
+                if (k2_offset >= 0 && k2_offset < length && v2[k2_offset] != -1) {
+                    if (x1 >= n - v2[k2_offset]) {
+                        *x = x1;
+                        *y = y1;
+                        return true;
+                    }
+                }
+            }
+        }
+
+        // the same, from the ends of a and b backwards
+        for (long long k2 = -d + k2start; k2 <= d - k2end; k2 += 2) {
+            long long k2_offset = offset + k2;
+            long long x2;
+            if (k2 == -d || (k2 != d && v2[k2_offset - 1] < v2[k2_offset + 1])) {
+                x2 = v2[k2_offset + 1];
+            } else {
+                x2 = v2[k2_offset - 1] + 1;
+            }
+            long long y2 = x2 - k2;
+            while (x2 < n && y2 < m && a[n - x2 - 1] == b[m - y2 - 1]) {
+                ++x2;
+                ++y2;
+            }
+            v2[k2_offset] = x2;
+            if (x2 > n) {
+                k2end += 2;
+            } else if (y2 > m) {
+                k2start += 2;
+            } else if (!front) {
+                long long k1_offset = offset + delta - k2;
+                if (k1_offset >= 0 && k1_offset < length && v1[k1_offset] != -1) {
+                    long long x1 = v1[k1_offset];
+                    if (x1 >= n - x2) {
+                        *x = x1;
+                        *y = x1 - (k1_offset - offset);
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+/* whether a[a_begin, a_end) and b[b_begin, b_end) have a token in common;
+ * counts has an entry for every id and is left zeroed as it is found
+ */
+static bool
+have_common(vector<uint32_t>& counts, const vector<uint32_t>& a, const vector<uint32_t>& b,
+            const diffPart& p)
+{
+    for (size_t i = p.a_begin; i < p.a_end; ++i) {
+        counts[a[i]] = 1;
+    }
+    bool common = false;
+    for (size_t j = p.b_begin; j < p.b_end && !common; ++j) {
+        common = counts[b[j]] != 0;
+    }
+    for (size_t i = p.a_begin; i < p.a_end; ++i) {
+        counts[a[i]] = 0;
+    }
+    return common;
+}
+
+/* a shortest diff in space linear in the length of a and b, by splitting
+ * them at the middle snake of each part in turn
+ */
+static bool
+diff_linear(engineWorkspace *workspace, const vector<uint32_t>& a, const vector<uint32_t>& b,
+            long long budget, diffVisitor *visitor)
+{
+    workspace->counts.assign(id_limit(a, b), 0);
+
+    vector<diffPart>& parts = workspace->parts;
+    parts.clear();
+    diffPart whole = { 0, a.size(), 0, b.size() };
+    parts.push_back(whole);
+
+    while (!parts.empty()) {
+        diffPart p = parts.back();
+        parts.pop_back();
+
+        while (p.a_begin < p.a_end && p.b_begin < p.b_end && a[p.a_begin] == b[p.b_begin]) {
+            ++p.a_begin;
+            ++p.b_begin;
+        }
+        while (p.a_begin < p.a_end && p.b_begin < p.b_end && a[p.a_end - 1] == b[p.b_end - 1]) {
+            --p.a_end;
+            --p.b_end;
+        }
+        // parts with nothing in common, as after a blanking or a rewrite, are
+        // replaced without the quadratic search for a path through them
+        long long x, y;
+        bool abandoned = false;
+        if (p.a_begin == p.a_end || p.b_begin == p.b_end
+                || !have_common(workspace->counts, a, b, p)
+                || !middle_snake(workspace, &a[p.a_begin], p.a_end - p.a_begin,
+                                 &b[p.b_begin], p.b_end - p.b_begin, budget, &x, &y, &abandoned)) {
+            if (abandoned) {
+                return false;
+            }
+            visit_range(visitor, a, p.a_begin, p.a_end, dtl::SES_DELETE);
+            visit_range(visitor, b, p.b_begin, p.b_end, dtl::SES_ADD);
+            continue;
+        }
+        diffPart after = { p.a_begin + x, p.a_end, p.b_begin + y, p.b_end };
+        diffPart before = { p.a_begin, p.a_begin + x, p.b_begin, p.b_begin + y };
+        parts.push_back(after);
+        parts.push_back(before);
+    }
+    return true;
+}
+
+bool
+diff_tokens(enum diffengine engine, const vector<uint32_t>& a, const vector<uint32_t>& b,
+            long long budget, diffVisitor *visitor)
+{
+    engineWorkspace *workspace = threadWorkspace<engineWorkspace>::get();
+    switch (engine) {
+    case DIFF_ONP:
+        return diff_onp(workspace, a, b, budget, visitor);
+    case DIFF_HISTOGRAM:
+        return diff_histogram(workspace, a, b, budget, visitor);
+    case DIFF_LINEAR:
+        return diff_linear(workspace, a, b, budget, visitor);
+    }
+    return false;
+}
+
+void
+diff_tokens_by_count(const vector<uint32_t>& a, const vector<uint32_t>& b, diffVisitor *visitor)
+{
+    vector<uint32_t>& counts = threadWorkspace<engineWorkspace>::get()->counts;
+    counts.assign(id_limit(a, b), 0);
+    dtl::elemInfo info;
+    info.afterIdx = 0;
+
+    // the tokens of a beyond as many of each as b has are deleted
+    for (size_t j = 0; j < b.size(); ++j) {
+        ++counts[b[j]];
+    }
+    info.type = dtl::SES_DELETE;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (counts[a[i]] > 0) {
+            --counts[a[i]];
+        } else {
+            info.beforeIdx = i + 1;
+            (*visitor)(a[i], info);
+        }
+    }
+
+    // and likewise those of b are added
+    counts.assign(counts.size(), 0);
+    for (size_t i = 0; i < a.size(); ++i) {
+        ++counts[a[i]];
+    }
+    info.type = dtl::SES_ADD;
+    for (size_t j = 0; j < b.size(); ++j) {
+        if (counts[b[j]] > 0) {
+            --counts[b[j]];
+        } else {
+            info.beforeIdx = j + 1;
+            (*visitor)(b[j], info);
+        }
+    }
+}
@@ -0,0 +1,53 @@
+/*
+ * Diffs of two sequences of token ids, by one of several engines.
+ *
+ * DIFF_ONP is dtl's O(NP) algorithm, which finds a shortest edit script but
+ * takes time and memory quadratic in the number of differences, as on page
+ * blankings and large rewrites.
+ *
+ * DIFF_HISTOGRAM anchors the sequences at their rarest common token,
+ * extended to the longest run of common tokens around it, and diffs the
+ * parts before and after the anchor the same way; parts with no common token
+ * are replaced wholesale.  This runs in close to linear time and usually
+ * finds the same script, but not always a shortest one.  Parts whose common
+ * tokens are all too frequent to anchor on are diffed by O(NP).
+ *
+ * DIFF_LINEAR finds a shortest edit script, as O(NP) does, but in memory
+ * linear in the length of the sequences: it splits them where a path from
+ * their starts and one from their ends meet, and diffs the parts before and
+ * after that point the same way.  Of several shortest scripts it may find
+ * another than O(NP) does.
+ */
+
+#ifndef __DIFF_H_
+#define __DIFF_H_
+
+#include <stdint.h>
+#include <vector>
+#include "dtl/dtl.hpp"
+
+enum diffengine { DIFF_ONP, DIFF_HISTOGRAM, DIFF_LINEAR };
+
+// is passed the additions and deletions of a diff, in order
+typedef dtl::SesVisitor<uint32_t> diffVisitor;
+
+/* Passes the tokens which b adds to a and deletes from it to visitor, but
+ * not those they have in common, each with its index (from 1) in a or b as
+ * its beforeIdx.  Reuses buffers kept by the calling thread.
+ *
+ * Unless budget is 0, the search for a diff gives up once it would need more
+ * than budget differences, and false is returned; whatever was passed to the
+ * visitor by then is to be discarded.
+ */
+bool diff_tokens(enum diffengine engine, const std::vector<uint32_t>& a,
+                 const std::vector<uint32_t>& b, long long budget, diffVisitor *visitor);
+
+/* An approximation of a diff in linear time, from the number of times each
+ * token occurs: the tokens of a beyond as many as b has are deleted and
+ * those of b beyond as many as a has are added.  These are as few as any
+ * diff has, or fewer.
+ */
+void diff_tokens_by_count(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b,
+                          diffVisitor *visitor);
+
+#endif
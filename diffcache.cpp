@@ -0,0 +1,123 @@
+/*
+ * Per-article diff cache, see diffcache.h
+ */
+
+#include <pthread.h>
+#include "diffcache.h"
+
+using namespace std;
+
+// the bytes taken by a kept diff beyond its key and text: its list and map
+// nodes and the headers of its strings and vectors
+#define DIFF_CACHE_ENTRY_OVERHEAD 256
+
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long long total_hits = 0;
+static unsigned long long total_misses = 0;
+
+static size_t
+entry_size(const string& key, const cachedDiff& diff)
+{
+    return DIFF_CACHE_ENTRY_OVERHEAD + 2 * key.size()
+        + diff.additions.size() + diff.deletions.size();
+}
+
+void
+diff_cache_init(diffCache *c, size_t digest_size, size_t capacity)
+{
+    c->digest_size = digest_size;
+    c->size = 0;
+    c->capacity = capacity;
+    c->hits = 0;
+    c->misses = 0;
+}
+
+/* the entry which diff_cache_find() would answer with, or the end of the
+ * index
+ */
+static map<string, cachedDiffList::iterator>::const_iterator
+lookup(const diffCache *c, const unsigned char *from, const unsigned char *to,
+       bool token_diff, bool *reversed)
+{
+    string key((const char *) from, c->digest_size);
+    key.append((const char *) to, c->digest_size);
+    *reversed = false;
+    map<string, cachedDiffList::iterator>::const_iterator i = c->index.find(key);
+    if (i == c->index.end() && token_diff) {
+        key.assign((const char *) to, c->digest_size);
+        key.append((const char *) from, c->digest_size);
+        i = c->index.find(key);
+        *reversed = true;
+        if (i != c->index.end() && !i->second->second.token_diff) {
+            i = c->index.end();
+        }
+    }
+    return i;
+}
+
+const cachedDiff *
+diff_cache_find(diffCache *c, const unsigned char *from, const unsigned char *to,
+                bool token_diff, bool *reversed)
+{
+    map<string, cachedDiffList::iterator>::const_iterator i = lookup(c, from, to, token_diff, reversed);
+    if (i == c->index.end()) {
+        ++c->misses;
+        return NULL;
+    }
+
+    ++c->hits;
+    c->diffs.splice(c->diffs.begin(), c->diffs, i->second);
+    return &i->second->second;
+}
+
+bool
+diff_cache_contains(const diffCache *c, const unsigned char *from, const unsigned char *to,
+                    bool token_diff)
+{
+    bool reversed;
+    return lookup(c, from, to, token_diff, &reversed) != c->index.end();
+}
+
+void
+diff_cache_add(diffCache *c, const unsigned char *from, const unsigned char *to,
+               const cachedDiff& diff)
+{
+    string key((const char *) from, c->digest_size);
+    key.append((const char *) to, c->digest_size);
+    size_t size = entry_size(key, diff);
+    if (size > c->capacity || c->index.find(key) != c->index.end()) {
+        return;
+    }
+
+    while (c->size + size > c->capacity) {
+        const pair<string, cachedDiff>& oldest = c->diffs.back();
+        c->size -= entry_size(oldest.first, oldest.second);
+        c->index.erase(oldest.first);
+        c->diffs.pop_back();
+    }
+    c->diffs.push_front(make_pair(key, diff));
+    c->index[key] = c->diffs.begin();
+    c->size += size;
+}
+
+void
+diff_cache_free(diffCache *c)
+{
+    pthread_mutex_lock(&totals_lock);
+    total_hits += c->hits;
+    total_misses += c->misses;
+    pthread_mutex_unlock(&totals_lock);
+
+    c->index.clear();
+    c->diffs.clear();
+    c->size = 0;
+}
+
+void
+diff_cache_totals(unsigned long long *hits, unsigned long long *misses)
+{
+    pthread_mutex_lock(&totals_lock);
+    *hits = total_hits;
+    *misses = total_misses;
+    pthread_mutex_unlock(&totals_lock);
+}
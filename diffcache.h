@@ -0,0 +1,74 @@
+/*
+ * The diffs already taken between revisions of one article, so that a pair
+ * of texts diffed before, as happens over and over in edit wars and revert
+ * cycles, is answered without diffing it again.  A revert is the reverse of
+ * the edit it undoes, so a pair is also found the other way round, with its
+ * additions and deletions swapped.  That is a shortest diff too, but where
+ * several are equally short it need not be the one a diff of the pair would
+ * give, so the additions and deletions reported may differ.
+ *
+ * Diffs are keyed by the digests of both texts and kept in order of use; the
+ * least recently used are evicted once those kept would take more than the
+ * cache's capacity.
+ */
+
+#ifndef __DIFFCACHE_H_
+#define __DIFFCACHE_H_
+
+#include <stddef.h>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+// what a revision's row takes from its diff
+typedef struct {
+    std::string additions;
+    std::string deletions;
+    std::vector<bool> regex_matches_adds;
+    std::vector<bool> regex_matches_dels;
+    bool token_diff; // the additions and deletions are tokens, so can be swapped
+    bool approximate;
+} cachedDiff;
+
+// keys are the digest of the text diffed from followed by that diffed to
+typedef std::list<std::pair<std::string, cachedDiff> > cachedDiffList;
+
+typedef struct {
+    cachedDiffList diffs; // the most recently used first
+    std::map<std::string, cachedDiffList::iterator> index;
+    size_t digest_size;
+    size_t size;     // bytes taken by the diffs kept
+    size_t capacity;
+    unsigned long long hits;
+    unsigned long long misses;
+} diffCache;
+
+void diff_cache_init(diffCache *c, size_t digest_size, size_t capacity);
+
+/* The diff from the text with digest from to that with digest to, or NULL.
+ * If it was taken the other way round, *reversed is set, and its additions
+ * are the deletions wanted and its deletions the additions; only diffs in
+ * tokens are reversed, and only if token_diff, that is if the diff wanted
+ * would be in tokens too.
+ */
+const cachedDiff *diff_cache_find(diffCache *c, const unsigned char *from, const unsigned char *to,
+                                  bool token_diff, bool *reversed);
+
+/* whether diff_cache_find() would find a diff, without counting it or
+ * marking it used
+ */
+bool diff_cache_contains(const diffCache *c, const unsigned char *from, const unsigned char *to,
+                         bool token_diff);
+
+/* keeps the diff from the text with digest from to that with digest to */
+void diff_cache_add(diffCache *c, const unsigned char *from, const unsigned char *to,
+                    const cachedDiff& diff);
+
+/* adds the cache's hits and misses to the totals, and releases it */
+void diff_cache_free(diffCache *c);
+
+/* the hits and misses of all the caches freed so far */
+void diff_cache_totals(unsigned long long *hits, unsigned long long *misses);
+
+#endif
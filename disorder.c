@@ -23,6 +23,7 @@
 
 #include <math.h> //for log2()
 #include <stdio.h> //for NULL
+#include <string.h> //for memset()
 #include "disorder.h"
 
 #if defined(__FreeBSD__)
@@ -173,6 +174,79 @@ shannon_H(char* buf,
   return bits;
 }
 
+float
+shannon_H_freqs(const int* freqs,
+		long long length)
+{
+  int i = 0;
+  int num_events = 0; //`length' parameter
+  float freq = 0.0; //loop variable for holding freq from freqs[]
+  float prob = 0.0; //P(this token appearing)
+  float entropy = 0.0; //running entropy sum
+
+  if(NULL==freqs || 0==length)
+    return 0.0;
+
+  num_events = length;
+
+  //the same arithmetic as shannon_H(), so that results are identical
+  for(i=0;i<LIBDO_MAX_BYTES;i++)
+  {
+    if(0!=freqs[i])
+    {
+      freq = ((float)freqs[i]);
+      prob = (freq / ((float)num_events));
+      entropy += prob * log2(prob);
+    }
+  }
+
+  return -1.0 * entropy;
+}
+
+void
+disorder_reset(disorder_ctx* ctx)
+{
+  memset(ctx->freqs, 0, sizeof(ctx->freqs));
+}
+
+void
+disorder_add(disorder_ctx* ctx,
+	     const char* buf,
+	     long long length)
+{
+  const unsigned char* p = (const unsigned char*)buf;
+  long long i = 0;
+
+  //consecutive bytes go to different tables, so that repeated bytes do
+  //not make each increment wait for the previous one
+#if LIBDO_SUB_HISTOGRAMS == 4
+  for(;i+4<=length;i+=4)
+  {
+    ctx->freqs[0][p[i]]++;
+    ctx->freqs[1][p[i+1]]++;
+    ctx->freqs[2][p[i+2]]++;
+    ctx->freqs[3][p[i+3]]++;
+  }
+#endif
+  for(;i<length;i++)
+  {
+    ctx->freqs[0][p[i]]++;
+  }
+}
+
+void
+disorder_freqs(const disorder_ctx* ctx,
+	       int* freqs)
+{
+  int i = 0, j = 0;
+  for(i=0;i<LIBDO_MAX_BYTES;i++)
+  {
+    freqs[i] = 0;
+    for(j=0;j<LIBDO_SUB_HISTOGRAMS;j++)
+      freqs[i] += ctx->freqs[j][i];
+  }
+}
+
 int 
 get_num_tokens()
 {
@@ -41,6 +41,29 @@ extern "C" {
  */
 #define LIBDO_BUFFER_LEN   16384
 
+/** Byte frequencies are counted into this many interleaved tables, so
+ * that runs of the same byte do not wait on each other's increments */
+#define LIBDO_SUB_HISTOGRAMS 4
+
+/**
+ * The state of an entropy measurement owned by the caller, which makes
+ * the functions taking it reentrant: several threads may each measure
+ * their own buffers at once, which shannon_H() does not allow.
+ */
+typedef struct {
+  int freqs[LIBDO_SUB_HISTOGRAMS][LIBDO_MAX_BYTES];
+} disorder_ctx;
+
+/** Starts a new measurement. */
+void     disorder_reset(disorder_ctx*);
+
+/** Counts the next `length' bytes of the stream being measured. */
+void     disorder_add(disorder_ctx*, const char*, long long);
+
+/** Stores the frequency of each byte value counted so far in the
+ * LIBDO_MAX_BYTES entries of the second argument. */
+void     disorder_freqs(const disorder_ctx*, int*);
+
 /** 
  * Given a pointer to an array of bytes, return a float indicating the
  * level of entropy in bits (a number between zero and eight),
@@ -48,9 +71,20 @@ extern "C" {
  * indicates the number of bytes in the sequence. If this sequence
  * runs into unallocated memory, this function should fail with a
  * SIGSEGV.
+ *
+ * This function keeps its state in globals, so only one thread may
+ * call it at a time; see disorder_ctx for a reentrant alternative.
  */
 float    shannon_H(char*, long long);
 
+/**
+ * The same as shannon_H(), from the frequencies of each of the 256 byte
+ * values in a buffer of `length' bytes, as counted by the caller. Uses no
+ * global state, so it may be called from several threads at once; it
+ * does not update the values reported by the functions below.
+ */
+float    shannon_H_freqs(const int*, long long);
+
 /** Report the number of (unique) tokens seen. This is _not_ the
     number of individual events seen. For example, if the library sees
     the string `aaab', the number of events is 4 and the number of
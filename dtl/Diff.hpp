@@ -56,15 +56,23 @@ namespace dtl {
         size_t             delta;
         size_t             offset;
         long long          *fp;
+        vector< long long > fpBuffer;
         long long          editDistance;
         Lcs< elem >        lcs;
         Ses< elem >        ses;
         editPath           path;
         editPathCordinates pathCordinates;
+        editPathCordinates epc;
         bool               reverse;
         bool               huge;
         bool               unserious;
         bool               onlyEditDistance;
+        bool               onlyChanges;
+        long long          maxEditDistance;
+        bool               abandoned;
+        long long          xOffset;           // elements of A and B recorded
+        long long          yOffset;           // before restarting
+        SesVisitor< elem > *visitor;
         uniHunkVec         uniHunks;
         comparator         cmp;
     public :
@@ -83,6 +91,21 @@ namespace dtl {
         
         ~Diff() {}
         
+        /**
+         * start over with new sequences, keeping the buffers allocated
+         * for earlier ones, so that a Diff reused for many sequences
+         * settles on the allocations of the largest
+         */
+        void reset (const sequence& a, 
+                    const sequence& b) {
+            A = a;
+            B = b;
+            lcs.clear();
+            ses.clear();
+            uniHunks.clear();
+            init();
+        }
+        
         long long getEditDistance () const {
             return editDistance;
         }
@@ -131,6 +154,36 @@ namespace dtl {
             this->onlyEditDistance = true;
         }
         
+        /**
+         * record neither the common elements of the SES nor the LCS
+         */
+        void onOnlyChanges () {
+            this->onlyChanges = true;
+        }
+        
+        /**
+         * give up the search once the edit distance is known to be larger
+         * than d; 0 searches on however large it is
+         */
+        void setMaxEditDistance (long long d) {
+            this->maxEditDistance = d;
+        }
+        
+        /**
+         * whether compose() gave up, in which case the SES and LCS are
+         * incomplete and edits already passed to the visitor are void
+         */
+        bool isAbandoned () const {
+            return abandoned;
+        }
+        
+        /**
+         * pass the SES to v while it is recorded instead of storing it
+         */
+        void setSesVisitor (SesVisitor< elem > *v) {
+            this->visitor = v;
+        }
+        
         /**
          * patching with Unified Format Hunks
          */
@@ -219,13 +272,17 @@ namespace dtl {
             }
             
             long long p = -1;
-            fp = new long long[M + N + 3];
-            fill(&fp[0], &fp[M + N + 3], -1);
-            path = editPath(M + N + 3);
-            fill(path.begin(), path.end(), -1);
+            pathCordinates.clear();
+            fpBuffer.assign(M + N + 3, -1);
+            fp = &fpBuffer[0];
+            path.assign(M + N + 3, -1);
         ONP:
             do {
                 ++p;
+                if (maxEditDistance > 0 && static_cast<long long>(delta) + 2 * p > maxEditDistance) {
+                    abandoned = true;
+                    return;
+                }
                 for (long long k=-p;k<=static_cast<long long>(delta)-1;++k) {
                     fp[k+offset] = snake(k, fp[k-1+offset]+1, fp[k+1+offset]);
                 }
@@ -238,11 +295,10 @@ namespace dtl {
             editDistance += static_cast<long long>(delta) + 2 * p;
             long long r = path[delta+offset];
             P cordinate;
-            editPathCordinates epc(0);
+            epc.clear();
             
             // only recoding editdistance
             if (onlyEditDistance) {
-                delete[] this->fp;
                 return;
             }
             
@@ -260,7 +316,6 @@ namespace dtl {
                 p = -1;
                 goto ONP;
             }
-            delete[] this->fp;
         }
 
         /**
@@ -490,6 +545,12 @@ namespace dtl {
             huge             = false;
             unserious        = false;
             onlyEditDistance = false;
+            onlyChanges      = false;
+            maxEditDistance  = 0;
+            abandoned        = false;
+            xOffset          = 0;
+            yOffset          = 0;
+            visitor          = NULL;
             fp               = NULL;
         }
         
@@ -528,25 +589,24 @@ namespace dtl {
                 while(px_idx < v[i].x || py_idx < v[i].y) {
                     if (v[i].y - v[i].x > py_idx - px_idx) {
                         if (!isReverse()) {
-                            ses.addSequence(*y, y_idx, 0, SES_ADD);
+                            recordEdit(*y, y_idx + yOffset, 0, SES_ADD);
                         } else {
-                            ses.addSequence(*y, y_idx, 0, SES_DELETE);
+                            recordEdit(*y, y_idx + yOffset, 0, SES_DELETE);
                         }
                         ++y;
                         ++y_idx;
                         ++py_idx;
                     } else if (v[i].y - v[i].x < py_idx - px_idx) {
                         if (!isReverse()) {
-                            ses.addSequence(*x, x_idx, 0, SES_DELETE);
+                            recordEdit(*x, x_idx + xOffset, 0, SES_DELETE);
                         } else {
-                            ses.addSequence(*x, x_idx, 0, SES_ADD);
+                            recordEdit(*x, x_idx + xOffset, 0, SES_ADD);
                         }
                         ++x;
                         ++x_idx;
                         ++px_idx;
                     } else {
-                        lcs.addSequence(*x);
-                        ses.addSequence(*x, x_idx, y_idx, SES_COMMON);
+                        recordEdit(*x, x_idx + xOffset, y_idx + yOffset, SES_COMMON);
                         ++x;
                         ++y;
                         ++x_idx;
@@ -564,44 +624,63 @@ namespace dtl {
                 // unserious difference
                 if (isUnserious()) {
                     if (!isReverse()) {
-                        recordOddSequence(x_idx, M, x, SES_DELETE);
-                        recordOddSequence(y_idx, N, y, SES_ADD);
+                        recordOddSequence(x_idx + xOffset, M + xOffset, x, SES_DELETE);
+                        recordOddSequence(y_idx + yOffset, N + yOffset, y, SES_ADD);
                     } else {
-                        recordOddSequence(x_idx, M, x, SES_ADD);
-                        recordOddSequence(y_idx, N, y, SES_DELETE);
+                        recordOddSequence(x_idx + xOffset, M + xOffset, x, SES_ADD);
+                        recordOddSequence(y_idx + yOffset, N + yOffset, y, SES_DELETE);
                     }
                     return true;
                 }
                 
                 // decent difference
-                sequence A_(A.begin() + (size_t)x_idx - 1, A.end());
-                sequence B_(B.begin() + (size_t)y_idx - 1, B.end());
-                A        = A_;
-                B        = B_;
+                // indices in the SES stay those in the whole sequences
+                xOffset += x_idx - 1;
+                yOffset += y_idx - 1;
+                A.erase(A.begin(), A.begin() + (size_t)x_idx - 1);
+                B.erase(B.begin(), B.begin() + (size_t)y_idx - 1);
                 M        = distance(A.begin(), A.end());
                 N        = distance(B.begin(), B.end());
                 delta    = N - M;
                 offset   = M + 1;
-                delete[] fp;
-                fp = new long long[M + N + 3];
-                fill(&fp[0], &fp[M + N + 3], -1);
+                fpBuffer.assign(M + N + 3, -1);
+                fp = &fpBuffer[0];
                 fill(path.begin(), path.end(), -1);
                 return false;
             }
             return true;
         }
         
+        /**
+         * record an edit of the SES, or pass it to the visitor
+         */
+        void inline recordEdit (const elem& e, long long beforeIdx, long long afterIdx, const edit_t type) {
+            if (type == SES_COMMON) {
+                if (onlyChanges) return;
+                lcs.addSequence(e);
+            }
+            if (visitor != NULL) {
+                elemInfo info;
+                info.beforeIdx = beforeIdx;
+                info.afterIdx  = afterIdx;
+                info.type      = type;
+                (*visitor)(e, info);
+            } else {
+                ses.addSequence(e, beforeIdx, afterIdx, type);
+            }
+        }
+        
         /**
          * record odd sequence to ses
          */
         void inline recordOddSequence (long long idx, long long length, sequence_const_iter it, const edit_t et) {
             while(idx < length){
-                ses.addSequence(*it, idx, 0, et);
+                recordEdit(*it, idx, 0, et);
                 ++it;
                 ++idx;
                 ++editDistance;
             }
-            ses.addSequence(*it, idx, 0, et);
+            recordEdit(*it, idx, 0, et);
             ++editDistance;
         }
         
@@ -57,6 +57,9 @@ namespace dtl {
         void addSequence (elem e) {
             sequence.push_back(e);
         }
+        void clear () {
+            sequence.clear();
+        }
     protected :
         elemVec sequence;
     };
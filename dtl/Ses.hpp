@@ -101,6 +101,13 @@ namespace dtl {
         sesElemVec getSequence () const {
             return sequence;
         }
+        
+        void clear () {
+            sequence.clear();
+            onlyAdd    = true;
+            onlyDelete = true;
+            onlyCopy   = true;
+        }
     private :
         sesElemVec sequence;
         bool       onlyAdd;
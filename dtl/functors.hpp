@@ -40,6 +40,18 @@
 
 namespace dtl {
     
+    /**
+     * visitor class template, which is passed the edits of a shortest edit
+     * script in order while it is recorded (see Diff::setSesVisitor)
+     */
+    template <typename elem>
+    class SesVisitor
+    {
+    public :
+        virtual ~SesVisitor () {}
+        virtual void operator() (const elem& e, const elemInfo& info) = 0;
+    };
+    
     /**
      * printer class template
      */
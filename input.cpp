@@ -0,0 +1,619 @@
+/*
+ * Decompressing input, see input.h
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+#include <bzlib.h>
+#include <zlib.h>
+#include <lzma.h>
+#include "input.h"
+#include "pipeline.h"
+
+using namespace std;
+
+#define MEGABYTE 1048576
+
+// compressed input is read in pieces of this size
+#define INPUT_READ_SIZE (4 * MEGABYTE)
+// decoders hand out decompressed blocks of this size
+#define INPUT_BLOCK_SIZE (4 * MEGABYTE)
+// decoded data which may wait in the queue before the decoders are paused
+#define INPUT_QUEUE_SIZE (64 * MEGABYTE)
+// bzip2 streams are batched into segments of at least this much compressed data
+#define BZIP2_SEGMENT_SIZE MEGABYTE
+
+struct inputStream {
+    FILE *file;
+    enum inputformat format;
+    int threads;
+
+    // bytes read while sniffing the format, which are consumed first
+    string head;
+
+    // for random access, the parts of the file to decode instead of all of it
+    vector<inputRange> ranges;
+
+    // decoded blocks, in order, and the one being drained by input_read()
+    deque<string> blocks;
+    size_t queued;
+    bool eof;
+    bool closing;
+    string current;
+    size_t current_pos;
+
+    pthread_t decoder;
+    pthread_mutex_t lock;
+    pthread_cond_t block_ready;  // input_read() waits on this
+    pthread_cond_t space_ready;  // the decoders wait on this
+};
+
+enum inputformat
+input_format(const char *head, size_t len)
+{
+    const unsigned char *h = (const unsigned char*) head;
+    if (len >= 4 && h[0] == 'B' && h[1] == 'Z' && h[2] == 'h' && h[3] >= '1' && h[3] <= '9')
+        return INPUT_BZIP2;
+    if (len >= 2 && h[0] == 0x1f && h[1] == 0x8b)
+        return INPUT_GZIP;
+    if (len >= 6 && memcmp(h, "\xfd" "7zXZ\0", 6) == 0)
+        return INPUT_XZ;
+    if (len >= 4 && memcmp(h, "\x28\xb5\x2f\xfd", 4) == 0)
+        return INPUT_ZSTD;
+    return INPUT_PLAIN;
+}
+
+static void
+input_fail(const char *what)
+{
+    cerr << "INPUT ERROR: " << what << endl;
+    exit(1);
+}
+
+/* reads up to len raw bytes, the sniffed head first */
+static size_t
+read_raw(inputStream *in, char *buf, size_t len)
+{
+    if (!in->head.empty()) {
+        size_t n = min(len, in->head.size());
+        memcpy(buf, in->head.data(), n);
+        in->head.erase(0, n);
+        return n;
+    }
+    return fread(buf, 1, len, in->file);
+}
+
+/* appends a decoded block to the queue, waiting while the queue is full;
+ * returns false if the stream is being closed
+ */
+static bool
+push_block(inputStream *in, string *block)
+{
+    if (block->empty())
+        return !in->closing;
+
+    pthread_mutex_lock(&in->lock);
+    while (in->queued > INPUT_QUEUE_SIZE && !in->closing)
+        pthread_cond_wait(&in->space_ready, &in->lock);
+    bool open = !in->closing;
+    if (open) {
+        in->queued += block->size();
+        in->blocks.push_back(string());
+        in->blocks.back().swap(*block);
+        pthread_cond_signal(&in->block_ready);
+    }
+    pthread_mutex_unlock(&in->lock);
+
+    return open;
+}
+
+static void
+push_eof(inputStream *in)
+{
+    pthread_mutex_lock(&in->lock);
+    in->eof = true;
+    pthread_cond_signal(&in->block_ready);
+    pthread_mutex_unlock(&in->lock);
+}
+
+/* decodes a series of concatenated bzip2 streams held in memory into out */
+static void
+decode_bzip2(const char *src, size_t len, string *out)
+{
+    vector<char> buf(INPUT_BLOCK_SIZE);
+    bz_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK)
+        input_fail("could not initialize the bzip2 decoder");
+    strm.next_in = (char*) src;
+    strm.avail_in = len;
+
+    for (;;) {
+        strm.next_out = &buf[0];
+        strm.avail_out = buf.size();
+        int ret = BZ2_bzDecompress(&strm);
+        out->append(&buf[0], buf.size() - strm.avail_out);
+        if (ret == BZ_STREAM_END) {
+            if (strm.avail_in == 0)
+                break;
+            // another stream follows
+            char *next_in = strm.next_in;
+            unsigned int avail_in = strm.avail_in;
+            BZ2_bzDecompressEnd(&strm);
+            memset(&strm, 0, sizeof(strm));
+            BZ2_bzDecompressInit(&strm, 0, 0);
+            strm.next_in = next_in;
+            strm.avail_in = avail_in;
+        } else if (ret != BZ_OK) {
+            input_fail("corrupt bzip2 data");
+        } else if (strm.avail_in == 0 && strm.avail_out != 0) {
+            input_fail("truncated bzip2 data");
+        }
+    }
+    BZ2_bzDecompressEnd(&strm);
+}
+
+/* the pipeline job which decodes a segment of whole bzip2 streams */
+static void
+decode_bzip2_segment(void *vsegment, string *out)
+{
+    string *segment = (string*) vsegment;
+    decode_bzip2(segment->data(), segment->size(), out);
+    delete segment;
+}
+
+static void
+queue_segment_output(void *vin, string *text)
+{
+    push_block((inputStream*) vin, text);
+}
+
+/* Finds the start of a bzip2 stream at or after from: the "BZh" signature
+ * and block size, followed by either the first block's magic (the digits
+ * of pi) or the end of stream magic (those of sqrt(pi)) for an empty stream.
+ * Streams start byte-aligned, while anything inside a stream is compressed,
+ * so a false match is astronomically unlikely.
+ */
+static size_t
+find_bzip2_stream(const string& buf, size_t from)
+{
+    static const unsigned char block_magic[6] = { 0x31, 0x41, 0x59, 0x26, 0x53, 0x59 };
+    static const unsigned char eos_magic[6] = { 0x17, 0x72, 0x45, 0x38, 0x50, 0x90 };
+    const char *p = buf.data();
+    size_t len = buf.size();
+    while (from + 10 <= len) {
+        const char *bz = (const char*) memmem(p + from, len - from, "BZh", 3);
+        if (bz == NULL || (size_t) (bz - p) + 10 > len)
+            break;
+        size_t at = bz - p;
+        if (p[at + 3] >= '1' && p[at + 3] <= '9'
+            && (memcmp(p + at + 4, block_magic, 6) == 0 || memcmp(p + at + 4, eos_magic, 6) == 0))
+            return at;
+        from = at + 1;
+    }
+    return string::npos;
+}
+
+/* Cuts a multistream bzip2 input into segments of whole streams and has a
+ * pool of decoders work on them concurrently; the pipeline delivers their
+ * output to the queue in order.
+ */
+static void
+decode_bzip2_multistream(inputStream *in, string *pending)
+{
+    pipeline *decoders = pipeline_create(in->threads, decode_bzip2_segment,
+                                         queue_segment_output, in,
+                                         in->threads * 4 * BZIP2_SEGMENT_SIZE);
+    vector<char> buf(INPUT_READ_SIZE);
+    bool done = false;
+    while (!done && !in->closing) {
+        size_t n = read_raw(in, &buf[0], buf.size());
+        if (n == 0) {
+            done = true;
+        } else {
+            pending->append(&buf[0], n);
+        }
+
+        // hand out everything up to the last stream start found
+        size_t cut = string::npos;
+        size_t at = BZIP2_SEGMENT_SIZE;
+        while ((at = find_bzip2_stream(*pending, at)) != string::npos) {
+            cut = at;
+            ++at;
+        }
+        if (done && !pending->empty()) {
+            cut = pending->size();
+        }
+        if (cut != string::npos) {
+            string *segment = new string(*pending, 0, cut);
+            pending->erase(0, cut);
+            pipeline_submit(decoders, segment, NULL, segment->size());
+        }
+    }
+    pipeline_finish(decoders);
+}
+
+/* decodes a single bzip2 stream, or a series of them, one after another */
+static void
+decode_bzip2_serial(inputStream *in)
+{
+    vector<char> inbuf(INPUT_READ_SIZE);
+    string block;
+    bz_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    BZ2_bzDecompressInit(&strm, 0, 0);
+    bool started = false;  // the current stream has consumed input
+    int streams = 0;
+
+    for (;;) {
+        if (strm.avail_in == 0) {
+            strm.avail_in = read_raw(in, &inbuf[0], inbuf.size());
+            strm.next_in = &inbuf[0];
+            if (strm.avail_in == 0) {
+                if (started)
+                    input_fail("truncated bzip2 data");
+                break;
+            }
+        }
+        block.resize(INPUT_BLOCK_SIZE);
+        strm.next_out = &block[0];
+        strm.avail_out = block.size();
+        int ret = BZ2_bzDecompress(&strm);
+        block.resize(block.size() - strm.avail_out);
+        if (ret == BZ_DATA_ERROR_MAGIC && !started && streams > 0)
+            break; // trailing garbage after the last stream, as bunzip2 allows
+        started = true;
+        if (!push_block(in, &block))
+            break;
+        if (ret == BZ_STREAM_END) {
+            ++streams;
+            char *next_in = strm.next_in;
+            unsigned int avail_in = strm.avail_in;
+            BZ2_bzDecompressEnd(&strm);
+            memset(&strm, 0, sizeof(strm));
+            BZ2_bzDecompressInit(&strm, 0, 0);
+            strm.next_in = next_in;
+            strm.avail_in = avail_in;
+            started = false;
+        } else if (ret != BZ_OK) {
+            input_fail("corrupt bzip2 data");
+        }
+    }
+    BZ2_bzDecompressEnd(&strm);
+}
+
+/* reads exactly len bytes at offset, or fails */
+static void
+read_at(FILE *file, long long offset, char *buf, size_t len)
+{
+    int fd = fileno(file);
+    while (len > 0) {
+        ssize_t n = pread(fd, buf, len, offset);
+        if (n <= 0)
+            input_fail("could not read the dump");
+        buf += n;
+        len -= n;
+        offset += n;
+    }
+}
+
+/* decodes the requested ranges of whole bzip2 streams on a pool of decoders,
+ * whose output reaches the queue in range order
+ */
+static void
+decode_bzip2_ranges(inputStream *in)
+{
+    struct stat st;
+    if (fstat(fileno(in->file), &st) != 0)
+        input_fail("could not stat the dump");
+
+    int threads = in->threads > 1 ? in->threads : 1;
+    pipeline *decoders = pipeline_create(threads, decode_bzip2_segment,
+                                         queue_segment_output, in,
+                                         threads * 4 * BZIP2_SEGMENT_SIZE);
+    // the ranges are scattered over the file, so ask for them all up front
+    for (size_t r = 0; r < in->ranges.size(); ++r) {
+        long long length = in->ranges[r].length;
+        posix_fadvise(fileno(in->file), in->ranges[r].offset, length < 0 ? 0 : length,
+                      POSIX_FADV_WILLNEED);
+    }
+
+    for (size_t r = 0; r < in->ranges.size() && !in->closing; ++r) {
+        long long offset = in->ranges[r].offset;
+        long long length = in->ranges[r].length;
+        if (length < 0)
+            length = st.st_size - offset;
+        if (length <= 0)
+            continue;
+        string *segment = new string(length, '\0');
+        read_at(in->file, offset, &(*segment)[0], length);
+        pipeline_submit(decoders, segment, NULL, segment->size());
+    }
+    pipeline_finish(decoders);
+}
+
+long long
+input_bzip2_stream_end(FILE *file, long long offset)
+{
+    vector<char> inbuf(MEGABYTE);
+    vector<char> outbuf(INPUT_BLOCK_SIZE);
+    int fd = fileno(file);
+    long long end = -1;
+    bz_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    BZ2_bzDecompressInit(&strm, 0, 0);
+
+    for (;;) {
+        if (strm.avail_in == 0) {
+            ssize_t n = pread(fd, &inbuf[0], inbuf.size(), offset);
+            if (n <= 0)
+                break;
+            offset += n;
+            strm.next_in = &inbuf[0];
+            strm.avail_in = n;
+        }
+        strm.next_out = &outbuf[0];
+        strm.avail_out = outbuf.size();
+        int ret = BZ2_bzDecompress(&strm);
+        if (ret == BZ_STREAM_END) {
+            end = offset - strm.avail_in;
+            break;
+        } else if (ret != BZ_OK) {
+            break;
+        }
+    }
+    BZ2_bzDecompressEnd(&strm);
+
+    return end;
+}
+
+/* decodes gzip data, including concatenated members */
+static void
+decode_gzip(inputStream *in)
+{
+    vector<char> inbuf(INPUT_READ_SIZE);
+    string block;
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, 16 + MAX_WBITS) != Z_OK)
+        input_fail("could not initialize the gzip decoder");
+    bool started = false;
+
+    for (;;) {
+        if (strm.avail_in == 0) {
+            strm.avail_in = read_raw(in, &inbuf[0], inbuf.size());
+            strm.next_in = (Bytef*) &inbuf[0];
+            if (strm.avail_in == 0) {
+                if (started)
+                    input_fail("truncated gzip data");
+                break;
+            }
+        }
+        block.resize(INPUT_BLOCK_SIZE);
+        strm.next_out = (Bytef*) &block[0];
+        strm.avail_out = block.size();
+        int ret = inflate(&strm, Z_NO_FLUSH);
+        block.resize(block.size() - strm.avail_out);
+        started = true;
+        if (!push_block(in, &block))
+            break;
+        if (ret == Z_STREAM_END) {
+            inflateReset(&strm);
+            started = false;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            input_fail("corrupt gzip data");
+        }
+    }
+    inflateEnd(&strm);
+}
+
+/* decodes xz data; liblzma decodes independent blocks on its own threads */
+static void
+decode_xz(inputStream *in)
+{
+    vector<char> inbuf(INPUT_READ_SIZE);
+    string block;
+    lzma_stream strm = LZMA_STREAM_INIT;
+    lzma_ret ret;
+#if LZMA_VERSION >= 50040002
+    lzma_mt mt;
+    memset(&mt, 0, sizeof(mt));
+    mt.flags = LZMA_CONCATENATED;
+    mt.threads = in->threads;
+    mt.memlimit_threading = lzma_physmem() / 4;
+    mt.memlimit_stop = UINT64_MAX;
+    ret = lzma_stream_decoder_mt(&strm, &mt);
+#else
+    ret = lzma_stream_decoder(&strm, UINT64_MAX, LZMA_CONCATENATED);
+#endif
+    if (ret != LZMA_OK)
+        input_fail("could not initialize the xz decoder");
+
+    lzma_action action = LZMA_RUN;
+    for (;;) {
+        if (strm.avail_in == 0 && action == LZMA_RUN) {
+            strm.avail_in = read_raw(in, &inbuf[0], inbuf.size());
+            strm.next_in = (const uint8_t*) &inbuf[0];
+            if (strm.avail_in == 0)
+                action = LZMA_FINISH;
+        }
+        block.resize(INPUT_BLOCK_SIZE);
+        strm.next_out = (uint8_t*) &block[0];
+        strm.avail_out = block.size();
+        ret = lzma_code(&strm, action);
+        block.resize(block.size() - strm.avail_out);
+        if (!push_block(in, &block))
+            break;
+        if (ret == LZMA_STREAM_END)
+            break;
+        if (ret != LZMA_OK)
+            input_fail(ret == LZMA_BUF_ERROR ? "truncated xz data" : "corrupt xz data");
+    }
+    lzma_end(&strm);
+}
+
+static void *
+decoder_main(void *vin)
+{
+    inputStream *in = (inputStream*) vin;
+
+    switch (in->format) {
+        case INPUT_BZIP2:
+            if (!in->ranges.empty()) {
+                decode_bzip2_ranges(in);
+            } else {
+                // a stream start shortly after the first means a multistream
+                // dump, whose streams can be decoded independently
+                string pending;
+                vector<char> buf(INPUT_READ_SIZE);
+                size_t n;
+                while (pending.size() < INPUT_READ_SIZE
+                       && (n = read_raw(in, &buf[0], INPUT_READ_SIZE - pending.size())) > 0) {
+                    pending.append(&buf[0], n);
+                }
+                if (in->threads > 1 && find_bzip2_stream(pending, 1) != string::npos) {
+                    decode_bzip2_multistream(in, &pending);
+                } else {
+                    in->head = pending;
+                    decode_bzip2_serial(in);
+                }
+            }
+            break;
+        case INPUT_GZIP:
+            decode_gzip(in);
+            break;
+        case INPUT_XZ:
+            decode_xz(in);
+            break;
+        default:
+            break;
+    }
+    push_eof(in);
+
+    return NULL;
+}
+
+static inputStream *
+new_input(FILE *file, int threads)
+{
+    inputStream *in = new inputStream;
+    in->file = file;
+    in->threads = threads;
+    in->queued = 0;
+    in->eof = false;
+    in->closing = false;
+    in->current_pos = 0;
+    return in;
+}
+
+static void
+start_decoder(inputStream *in)
+{
+    pthread_mutex_init(&in->lock, NULL);
+    pthread_cond_init(&in->block_ready, NULL);
+    pthread_cond_init(&in->space_ready, NULL);
+    pthread_create(&in->decoder, NULL, decoder_main, in);
+}
+
+inputStream *
+input_open(FILE *file, int threads)
+{
+    inputStream *in = new_input(file, threads);
+
+    // files are read front to back, which the kernel may read ahead for
+    struct stat st;
+    if (fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode)) {
+        posix_fadvise(fileno(file), 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    char head[6];
+    size_t n = fread(head, 1, sizeof(head), file);
+    in->head.assign(head, n);
+    in->format = input_format(head, n);
+
+    if (in->format == INPUT_ZSTD) {
+        cerr << "INPUT ERROR: zstd compressed dumps are not supported, "
+             << "decompress them with zstd -dc" << endl;
+        delete in;
+        return NULL;
+    }
+
+    if (in->format != INPUT_PLAIN) {
+        start_decoder(in);
+    }
+
+    return in;
+}
+
+inputStream *
+input_open_ranges(FILE *file, const vector<inputRange>& ranges, int threads)
+{
+    inputStream *in = new_input(file, threads);
+    in->format = INPUT_BZIP2;
+    in->ranges = ranges;
+    start_decoder(in);
+
+    return in;
+}
+
+size_t
+input_read(inputStream *in, char *buf, size_t len)
+{
+    if (in->format == INPUT_PLAIN) {
+        size_t n = read_raw(in, buf, len);
+        if (n < len && n > 0 && in->head.empty()) {
+            // top up after the sniffed head, so short reads mean the end
+            n += fread(buf + n, 1, len - n, in->file);
+        }
+        return n;
+    }
+
+    size_t copied = 0;
+    while (copied < len) {
+        if (in->current_pos == in->current.size()) {
+            pthread_mutex_lock(&in->lock);
+            while (in->blocks.empty() && !in->eof)
+                pthread_cond_wait(&in->block_ready, &in->lock);
+            if (in->blocks.empty()) {
+                pthread_mutex_unlock(&in->lock);
+                break;
+            }
+            in->current.swap(in->blocks.front());
+            in->blocks.pop_front();
+            in->queued -= in->current.size();
+            in->current_pos = 0;
+            pthread_cond_signal(&in->space_ready);
+            pthread_mutex_unlock(&in->lock);
+        }
+        size_t n = min(len - copied, in->current.size() - in->current_pos);
+        memcpy(buf + copied, in->current.data() + in->current_pos, n);
+        in->current_pos += n;
+        copied += n;
+    }
+    return copied;
+}
+
+void
+input_close(inputStream *in)
+{
+    if (in->format != INPUT_PLAIN) {
+        pthread_mutex_lock(&in->lock);
+        in->closing = true;
+        pthread_cond_broadcast(&in->space_ready);
+        pthread_mutex_unlock(&in->lock);
+        pthread_join(in->decoder, NULL);
+        pthread_mutex_destroy(&in->lock);
+        pthread_cond_destroy(&in->block_ready);
+        pthread_cond_destroy(&in->space_ready);
+    }
+    delete in;
+}
@@ -0,0 +1,55 @@
+/*
+ * Reads a dump from a file or pipe, decompressing it on the fly.
+ *
+ * The format is sniffed from the first bytes of the input: plain XML is read
+ * as is, while bzip2, gzip and xz streams are decoded on background threads
+ * into an ordered queue of buffers which input_read() drains.  bzip2
+ * multistream dumps (such as Wikimedia's pages-articles-multistream) are cut
+ * at stream boundaries and the streams decoded concurrently, or, given their
+ * index, only selected streams are read at all.
+ */
+
+#ifndef __INPUT_H_
+#define __INPUT_H_
+
+#include <stdio.h>
+#include <vector>
+
+enum inputformat { INPUT_PLAIN, INPUT_BZIP2, INPUT_GZIP, INPUT_XZ, INPUT_ZSTD };
+
+typedef struct inputStream inputStream;
+
+// a byte range of a file; a negative length extends to the end of the file
+typedef struct {
+    long long offset;
+    long long length;
+} inputRange;
+
+/* identifies the format from at least the first 6 bytes of a file */
+enum inputformat input_format(const char *head, size_t len);
+
+/* Starts reading from file, which stays owned by the caller.  threads bounds
+ * the number of decoder threads used for formats which can be decoded in
+ * parallel.  Returns NULL, after reporting why, for unsupported formats.
+ */
+inputStream *input_open(FILE *file, int threads);
+
+/* Decodes only the given ranges of a seekable bzip2 file, in order, each
+ * holding one or more whole streams.
+ */
+inputStream *input_open_ranges(FILE *file, const std::vector<inputRange>& ranges, int threads);
+
+/* returns the offset just past the bzip2 stream which starts at offset, or
+ * -1 if it cannot be decoded
+ */
+long long input_bzip2_stream_end(FILE *file, long long offset);
+
+/* Copies up to len decoded bytes into buf; returns 0 only at the end of the
+ * input.  Decoding errors are reported and end the program.
+ */
+size_t input_read(inputStream *in, char *buf, size_t len);
+
+/* stops any decoder threads and frees the stream */
+void input_close(inputStream *in);
+
+#endif
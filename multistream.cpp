@@ -0,0 +1,110 @@
+/*
+ * Multistream index handling, see multistream.h
+ */
+
+#include <stdlib.h>
+#include <iostream>
+#include <algorithm>
+#include "multistream.h"
+
+using namespace std;
+
+#define MEGABYTE 1048576
+
+bool
+multistream_ranges(const char *index_path, FILE *dump, multistream_filter_fn wanted,
+                   vector<inputRange> *ranges)
+{
+    FILE *index_file = fopen(index_path, "rb");
+    if (index_file == NULL) {
+        cerr << "could not open the index " << index_path << endl;
+        return false;
+    }
+    inputStream *index = input_open(index_file, 1);
+    if (index == NULL) {
+        fclose(index_file);
+        return false;
+    }
+
+    // stream offsets in index order, and whether each holds a wanted page
+    vector<long long> offsets;
+    vector<bool> selected;
+
+    vector<char> buf(MEGABYTE);
+    string pending, line;
+    bool ok = true;
+    size_t len;
+    do {
+        len = input_read(index, &buf[0], buf.size());
+        pending.append(&buf[0], len);
+        size_t start = 0, eol;
+        while (ok && start < pending.size()) {
+            eol = pending.find('\n', start);
+            if (eol == string::npos) {
+                if (len > 0)
+                    break;
+                eol = pending.size(); // an unterminated last line
+            }
+            line.assign(pending, start, eol - start);
+            start = eol + 1;
+            if (line.empty())
+                continue;
+
+            size_t id_at = line.find(':');
+            size_t title_at = (id_at == string::npos) ? string::npos : line.find(':', id_at + 1);
+            if (title_at == string::npos) {
+                cerr << "malformed index line: " << line << endl;
+                ok = false;
+                break;
+            }
+            long long offset = strtoll(line.c_str(), NULL, 10);
+            unsigned long pageid = strtoul(line.c_str() + id_at + 1, NULL, 10);
+            bool want = wanted(pageid, line.substr(title_at + 1));
+
+            if (offsets.empty() || offsets.back() != offset) {
+                offsets.push_back(offset);
+                selected.push_back(want);
+            } else if (want) {
+                selected.back() = true;
+            }
+        }
+        pending.erase(0, min(start, pending.size()));
+    } while (len > 0 && ok);
+
+    input_close(index);
+    fclose(index_file);
+    if (!ok)
+        return false;
+    if (offsets.empty()) {
+        cerr << "the index " << index_path << " is empty" << endl;
+        return false;
+    }
+
+    // the streams after the last indexed one close the document
+    long long tail = input_bzip2_stream_end(dump, offsets.back());
+    if (tail < 0) {
+        cerr << "the dump does not match the index " << index_path << endl;
+        return false;
+    }
+
+    // the header, with the opening <mediawiki> and <siteinfo>, precedes the
+    // first page stream
+    inputRange range;
+    range.offset = 0;
+    range.length = offsets[0];
+    ranges->push_back(range);
+
+    for (size_t s = 0; s < offsets.size(); ++s) {
+        if (!selected[s])
+            continue;
+        range.offset = offsets[s];
+        range.length = ((s + 1 < offsets.size()) ? offsets[s + 1] : tail) - offsets[s];
+        ranges->push_back(range);
+    }
+
+    range.offset = tail;
+    range.length = -1;
+    ranges->push_back(range);
+
+    return true;
+}
@@ -0,0 +1,29 @@
+/*
+ * Random access to Wikimedia's multistream bzip2 dumps.
+ *
+ * Each line of a multistream index has the form offset:pageid:title, giving
+ * the byte offset of the bzip2 stream (of about a hundred pages) which holds
+ * the page.  Given a filter on page ids and titles, the index tells us which
+ * streams need to be decoded at all.
+ */
+
+#ifndef __MULTISTREAM_H_
+#define __MULTISTREAM_H_
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "input.h"
+
+typedef bool (*multistream_filter_fn)(unsigned long pageid, const std::string& title);
+
+/* Reads the index at index_path, which may itself be compressed, and fills
+ * ranges with the parts of dump to decode: the stream holding the document
+ * header, every stream holding a page accepted by wanted, and the streams
+ * after the last indexed one, which close the document.  Returns false, after
+ * reporting why, if the index cannot be used.
+ */
+bool multistream_ranges(const char *index_path, FILE *dump, multistream_filter_fn wanted,
+                        std::vector<inputRange> *ranges);
+
+#endif
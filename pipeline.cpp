@@ -0,0 +1,304 @@
+/*
+ * Worker pool with ordered output, see pipeline.h
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+#include "pipeline.h"
+
+using namespace std;
+
+typedef struct {
+    void *data;
+    void *strand;
+    size_t cost;
+    unsigned long seq;
+} pipeline_job;
+
+typedef struct {
+    string text;
+    size_t cost;
+} pipeline_result;
+
+struct pipeline {
+    pipeline_work_fn work;
+    pipeline_output_fn output;
+    void *output_arg;
+
+    // cost of jobs submitted but not yet written, and its ceiling
+    size_t cost;
+    size_t max_cost;
+
+    unsigned long next_seq;    // assigned to the next submitted job
+    unsigned long next_write;  // the job the writer is waiting for
+    bool finishing;
+
+    deque<pipeline_job> ready;
+    // jobs of a strand which is running or ready wait here for their turn;
+    // a strand has an entry exactly while one of its jobs is ready or running
+    map<void*, deque<pipeline_job> > strands;
+    map<unsigned long, pipeline_result> results;
+
+    vector<pthread_t> workers;
+    pthread_t writer;
+
+    pthread_mutex_t lock;
+    pthread_cond_t job_ready;        // workers wait on this
+    pthread_cond_t result_ready;     // the writer waits on this
+    pthread_cond_t capacity_ready;   // the producer waits on this
+};
+
+static void *
+worker_main(void *vp)
+{
+    pipeline *p = (pipeline*) vp;
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (p->ready.empty() && !(p->finishing && p->strands.empty()))
+            pthread_cond_wait(&p->job_ready, &p->lock);
+        if (p->ready.empty())
+            break;
+
+        pipeline_job job = p->ready.front();
+        p->ready.pop_front();
+        pthread_mutex_unlock(&p->lock);
+
+        pipeline_result result;
+        result.cost = job.cost;
+        p->work(job.data, &result.text);
+
+        pthread_mutex_lock(&p->lock);
+        p->results[job.seq].text.swap(result.text);
+        p->results[job.seq].cost = result.cost;
+        if (job.seq == p->next_write)
+            pthread_cond_signal(&p->result_ready);
+
+        // release the next job of this strand, or retire the strand
+        if (job.strand != NULL) {
+            map<void*, deque<pipeline_job> >::iterator s = p->strands.find(job.strand);
+            if (s->second.empty()) {
+                p->strands.erase(s);
+                if (p->finishing && p->strands.empty())
+                    pthread_cond_broadcast(&p->job_ready);
+            } else {
+                p->ready.push_back(s->second.front());
+                s->second.pop_front();
+                pthread_cond_signal(&p->job_ready);
+            }
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return NULL;
+}
+
+static void *
+writer_main(void *vp)
+{
+    pipeline *p = (pipeline*) vp;
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        map<unsigned long, pipeline_result>::iterator r;
+        while ((r = p->results.find(p->next_write)) == p->results.end()
+               && !(p->finishing && p->next_write == p->next_seq))
+            pthread_cond_wait(&p->result_ready, &p->lock);
+        if (r == p->results.end())
+            break;
+
+        pipeline_result result;
+        result.text.swap(r->second.text);
+        result.cost = r->second.cost;
+        p->results.erase(r);
+        pthread_mutex_unlock(&p->lock);
+
+        p->output(p->output_arg, &result.text);
+
+        pthread_mutex_lock(&p->lock);
+        ++p->next_write;
+        p->cost -= result.cost;
+        pthread_cond_signal(&p->capacity_ready);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return NULL;
+}
+
+pipeline *
+pipeline_create(int threads, pipeline_work_fn work,
+                pipeline_output_fn output, void *output_arg, size_t max_cost)
+{
+    pipeline *p = new pipeline;
+    p->work = work;
+    p->output = output;
+    p->output_arg = output_arg;
+    p->cost = 0;
+    p->max_cost = max_cost;
+    p->next_seq = 0;
+    p->next_write = 0;
+    p->finishing = false;
+
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->job_ready, NULL);
+    pthread_cond_init(&p->result_ready, NULL);
+    pthread_cond_init(&p->capacity_ready, NULL);
+
+    p->workers.resize(threads);
+    for (int i = 0; i < threads; ++i)
+        pthread_create(&p->workers[i], NULL, worker_main, p);
+    pthread_create(&p->writer, NULL, writer_main, p);
+
+    return p;
+}
+
+void
+pipeline_submit(pipeline *p, void *data, void *strand, size_t cost)
+{
+    pipeline_job job;
+    job.data = data;
+    job.strand = strand;
+    job.cost = cost;
+
+    pthread_mutex_lock(&p->lock);
+
+    // an oversized job is still admitted once everything before it is written
+    while (p->cost > 0 && p->cost + cost > p->max_cost)
+        pthread_cond_wait(&p->capacity_ready, &p->lock);
+
+    job.seq = p->next_seq++;
+    p->cost += cost;
+
+    map<void*, deque<pipeline_job> >::iterator s;
+    if (strand != NULL && (s = p->strands.find(strand)) != p->strands.end()) {
+        s->second.push_back(job);
+    } else {
+        if (strand != NULL)
+            p->strands[strand];
+        p->ready.push_back(job);
+        pthread_cond_signal(&p->job_ready);
+    }
+
+    pthread_mutex_unlock(&p->lock);
+}
+
+void
+pipeline_finish(pipeline *p)
+{
+    pthread_mutex_lock(&p->lock);
+    p->finishing = true;
+    pthread_cond_broadcast(&p->job_ready);
+    pthread_cond_signal(&p->result_ready);
+    pthread_mutex_unlock(&p->lock);
+
+    for (size_t i = 0; i < p->workers.size(); ++i)
+        pthread_join(p->workers[i], NULL);
+    pthread_join(p->writer, NULL);
+
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->job_ready);
+    pthread_cond_destroy(&p->result_ready);
+    pthread_cond_destroy(&p->capacity_ready);
+    delete p;
+}
+
+void
+pipeline_write_file(void *file, string *text)
+{
+    fwrite(text->data(), 1, text->size(), (FILE*) file);
+}
+
+typedef struct {
+    void (*fn)(void *arg, size_t i);
+    void *arg;
+    size_t n;
+    size_t next;    // next index to hand out, claimed atomically
+    size_t running; // helpers inside the loop, guarded by the pool's lock
+} parallel_loop;
+
+static void
+parallel_loop_run(parallel_loop *loop)
+{
+    size_t i;
+    while ((i = __sync_fetch_and_add(&loop->next, 1)) < loop->n)
+        loop->fn(loop->arg, i);
+}
+
+// The helper threads which every thread calling parallel_for() shares, so
+// that however many threads call it there are only as many helpers as the
+// most any loop asks for, and what they keep per thread, such as the
+// workspaces of diffs, is reused from one loop to the next.  They run until
+// the process exits.
+static size_t pool_threads = 0;
+// loops which may still have indices to hand out, oldest first
+static deque<parallel_loop*> pool_loops;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_start = PTHREAD_COND_INITIALIZER; // the helpers wait on this
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;  // the calling threads wait on this
+
+static void *
+parallel_helper_main(void *)
+{
+    pthread_mutex_lock(&pool_lock);
+    for (;;) {
+        while (pool_loops.empty())
+            pthread_cond_wait(&pool_start, &pool_lock);
+
+        parallel_loop *loop = pool_loops.front();
+        ++loop->running;
+        pthread_mutex_unlock(&pool_lock);
+        parallel_loop_run(loop);
+        pthread_mutex_lock(&pool_lock);
+
+        // every index has been handed out, so no one else need join the loop
+        if (!pool_loops.empty() && pool_loops.front() == loop)
+            pool_loops.pop_front();
+        if (--loop->running == 0)
+            pthread_cond_broadcast(&pool_done);
+    }
+    return NULL;
+}
+
+void
+parallel_for(size_t n, int threads, void (*fn)(void *arg, size_t i), void *arg)
+{
+    if (threads <= 1 || n <= 1) {
+        for (size_t i = 0; i < n; ++i)
+            fn(arg, i);
+        return;
+    }
+
+    parallel_loop loop;
+    loop.fn = fn;
+    loop.arg = arg;
+    loop.n = n;
+    loop.next = 0;
+    loop.running = 0;
+
+    pthread_mutex_lock(&pool_lock);
+    size_t helpers = min((size_t) threads, n) - 1;
+    while (pool_threads < helpers) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, parallel_helper_main, NULL);
+        pthread_detach(thread);
+        ++pool_threads;
+    }
+    pool_loops.push_back(&loop);
+    pthread_cond_broadcast(&pool_start);
+    pthread_mutex_unlock(&pool_lock);
+
+    parallel_loop_run(&loop);
+
+    // the loop lives on this stack, so it must be out of the helpers' reach
+    pthread_mutex_lock(&pool_lock);
+    deque<parallel_loop*>::iterator l = find(pool_loops.begin(), pool_loops.end(), &loop);
+    if (l != pool_loops.end())
+        pool_loops.erase(l);
+    while (loop.running > 0)
+        pthread_cond_wait(&pool_done, &pool_lock);
+    pthread_mutex_unlock(&pool_lock);
+}
@@ -0,0 +1,55 @@
+/*
+ * A small worker pool with ordered output.
+ *
+ * Jobs are submitted from a single producer (the XML parser thread) and
+ * handed to a pool of worker threads.  Each worker renders its job into a
+ * string, and a writer thread emits those strings in exactly the order the
+ * jobs were submitted, so the output is identical to a serial run.  The
+ * strings usually go to a file, but may be handed to any consumer, e.g. the
+ * parser in the case of decompressed input.
+ *
+ * Jobs which share a strand (e.g. consecutive chunks of the same article)
+ * never run concurrently and are run in the order they were submitted, which
+ * lets them carry state from one job to the next.
+ *
+ * parallel_for() splits a single job's work over helper threads, which all
+ * calling threads share and keep for their later calls.
+ */
+
+#ifndef __PIPELINE_H_
+#define __PIPELINE_H_
+
+#include <stdio.h>
+#include <string>
+
+// renders one job into out; also responsible for freeing the job
+typedef void (*pipeline_work_fn)(void *job, std::string *out);
+
+// consumes the rendered jobs in order; may take the string's contents
+typedef void (*pipeline_output_fn)(void *arg, std::string *text);
+
+typedef struct pipeline pipeline;
+
+/* Starts `threads' workers and a writer thread which passes their results to
+ * output.  Submission blocks while the summed cost of jobs which have not yet
+ * been output exceeds max_cost, which bounds memory use on huge inputs.
+ */
+pipeline *pipeline_create(int threads, pipeline_work_fn work,
+                          pipeline_output_fn output, void *output_arg, size_t max_cost);
+
+/* an output function which writes to the FILE* given as its argument */
+void pipeline_write_file(void *file, std::string *text);
+
+/* Queues a job.  Jobs with the same non-NULL strand are serialized. */
+void pipeline_submit(pipeline *p, void *job, void *strand, size_t cost);
+
+/* Waits for every queued job to be written, then joins and frees the pool. */
+void pipeline_finish(pipeline *p);
+
+/* Calls fn(arg, i) for every i in [0, n) on the calling thread and up to
+ * `threads' - 1 helpers, and returns once all calls have returned.  The
+ * helpers may be working through other threads' loops at the same time.
+ */
+void parallel_for(size_t n, int threads, void (*fn)(void *arg, size_t i), void *arg);
+
+#endif
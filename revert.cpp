@@ -0,0 +1,237 @@
+/*
+ * Revert detection table, see revert.h
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "revert.h"
+
+#define REVERT_INITIAL_CAPACITY 64
+
+// a released block of slots per thread, see revert_free()
+static pthread_key_t spare_key;
+static pthread_once_t spare_once = PTHREAD_ONCE_INIT;
+
+typedef struct {
+    revertSlot *slots;
+    size_t block;
+} spareBlock;
+
+static void
+free_spare(void *vspare)
+{
+    spareBlock *spare = (spareBlock*) vspare;
+    free(spare->slots);
+    delete spare;
+}
+
+static void
+create_spare_key(void)
+{
+    pthread_key_create(&spare_key, free_spare);
+}
+
+static spareBlock *
+thread_spare(void)
+{
+    pthread_once(&spare_once, create_spare_key);
+    spareBlock *spare = (spareBlock*) pthread_getspecific(spare_key);
+    if (spare == NULL) {
+        spare = new spareBlock;
+        spare->slots = NULL;
+        spare->block = 0;
+        pthread_setspecific(spare_key, spare);
+    }
+    return spare;
+}
+
+/* a block of at least capacity slots, preferably this thread's spare */
+static revertSlot *
+acquire(size_t capacity, size_t *block)
+{
+    spareBlock *spare = thread_spare();
+    if (spare->block >= capacity) {
+        revertSlot *slots = spare->slots;
+        *block = spare->block;
+        spare->slots = NULL;
+        spare->block = 0;
+        return slots;
+    }
+    *block = capacity;
+    return (revertSlot*) malloc(capacity * sizeof(revertSlot));
+}
+
+/* keeps the larger of slots and this thread's spare as the spare */
+static void
+release(revertSlot *slots, size_t block)
+{
+    spareBlock *spare = thread_spare();
+    if (block > spare->block) {
+        free(spare->slots);
+        spare->slots = slots;
+        spare->block = block;
+    } else {
+        free(slots);
+    }
+}
+
+void
+revert_init(revertTable *t, size_t radius)
+{
+    t->slots = NULL;
+    t->capacity = 0;
+    t->block = 0;
+    t->count = 0;
+    t->radius = radius;
+    t->ring = NULL;
+    t->index = NULL;
+    t->index_mask = 0;
+    t->seq = 0;
+}
+
+/* makes the table capacity slots large, rehashing what it holds */
+static void
+resize(revertTable *t, size_t capacity)
+{
+    revertSlot *old = t->slots;
+    size_t old_capacity = t->capacity;
+    size_t old_block = t->block;
+
+    // a reused block may be larger than needed, but only the slots in use
+    // need clearing
+    t->slots = acquire(capacity, &t->block);
+    t->capacity = capacity;
+    memset(t->slots, 0, capacity * sizeof(revertSlot));
+
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < old_capacity; ++i) {
+        if (old[i].revid == 0)
+            continue;
+        size_t h = old[i].digest[0] & mask;
+        while (t->slots[h].revid != 0)
+            h = (h + 1) & mask;
+        t->slots[h] = old[i];
+    }
+    if (old != NULL)
+        release(old, old_block);
+}
+
+/* the index slot holding ring entry seq, whose digest is key, or the empty
+ * slot where it would go
+ */
+static size_t
+index_find(revertTable *t, const uint64_t *key)
+{
+    size_t h = key[0] & t->index_mask;
+    while (t->index[h] != 0) {
+        revertSlot *entry = &t->ring[(t->index[h] - 1) % t->radius];
+        if (entry->digest[0] == key[0] && entry->digest[1] == key[1])
+            break;
+        h = (h + 1) & t->index_mask;
+    }
+    return h;
+}
+
+/* empties index slot i, moving later entries of its probe run back into
+ * the gap so that no lookup stops short of them
+ */
+static void
+index_delete(revertTable *t, size_t i)
+{
+    size_t j = i;
+    for (;;) {
+        j = (j + 1) & t->index_mask;
+        if (t->index[j] == 0)
+            break;
+        size_t home = t->ring[(t->index[j] - 1) % t->radius].digest[0] & t->index_mask;
+        // entry j may fill the gap unless its home lies cyclically in (i, j]
+        bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (!stays) {
+            t->index[i] = t->index[j];
+            i = j;
+        }
+    }
+    t->index[i] = 0;
+}
+
+static bool
+record_windowed(revertTable *t, const uint64_t *key, uint64_t revid, uint64_t *previous)
+{
+    if (t->ring == NULL) {
+        size_t size = 2;
+        while (size < 2 * t->radius)
+            size *= 2;
+        t->ring = (revertSlot*) malloc(t->radius * sizeof(revertSlot));
+        t->index = (uint64_t*) calloc(size, sizeof(uint64_t));
+        t->index_mask = size - 1;
+    }
+
+    size_t h = index_find(t, key);
+    bool found = t->index[h] != 0;
+    if (found)
+        *previous = t->ring[(t->index[h] - 1) % t->radius].revid - 1;
+
+    // the oldest revision leaves the window; its index entry goes unless a
+    // later revision with the same digest has taken it over
+    if (t->seq >= t->radius) {
+        uint64_t oldest = t->seq - t->radius;
+        size_t o = index_find(t, t->ring[oldest % t->radius].digest);
+        if (t->index[o] == oldest + 1)
+            index_delete(t, o);
+    }
+
+    revertSlot *entry = &t->ring[t->seq % t->radius];
+    entry->digest[0] = key[0];
+    entry->digest[1] = key[1];
+    entry->revid = revid + 1;
+    t->index[index_find(t, key)] = ++t->seq;
+
+    return found;
+}
+
+bool
+revert_record(revertTable *t, const unsigned char *digest, uint64_t revid, uint64_t *previous)
+{
+    if (t->radius > 0) {
+        uint64_t key[2];
+        memcpy(key, digest, sizeof(key));
+        return record_windowed(t, key, revid, previous);
+    }
+
+    if ((t->count + 1) * 2 > t->capacity)
+        resize(t, t->capacity ? t->capacity * 2 : REVERT_INITIAL_CAPACITY);
+
+    uint64_t key[2];
+    memcpy(key, digest, sizeof(key));
+
+    // digests are uniformly distributed, so their low bits are the hash
+    size_t mask = t->capacity - 1;
+    size_t h = key[0] & mask;
+    for (;;) {
+        revertSlot *slot = &t->slots[h];
+        if (slot->revid == 0) {
+            slot->digest[0] = key[0];
+            slot->digest[1] = key[1];
+            slot->revid = revid + 1;
+            ++t->count;
+            return false;
+        }
+        if (slot->digest[0] == key[0] && slot->digest[1] == key[1]) {
+            *previous = slot->revid - 1;
+            slot->revid = revid + 1;
+            return true;
+        }
+        h = (h + 1) & mask;
+    }
+}
+
+void
+revert_free(revertTable *t)
+{
+    if (t->slots != NULL)
+        release(t->slots, t->block);
+    free(t->ring);
+    free(t->index);
+    revert_init(t, t->radius);
+}
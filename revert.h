@@ -0,0 +1,55 @@
+/*
+ * Revert detection state of one article: for every text digest seen so far,
+ * the latest revision with that text.
+ *
+ * Digests are truncated to their first 128 bits and kept with the revision
+ * id in a flat, linearly probed hash table, so recording a revision costs
+ * one probe sequence and no allocation.  A table's storage is handed to the
+ * next table created on the same thread when it is freed, so a long run
+ * settles on one block per thread.
+ *
+ * With a revert radius, only the last `radius' revisions are remembered: a
+ * ring buffer holds their digests and a small hash table indexes the latest
+ * ring entry of each digest, so the state of an article has a fixed size.
+ */
+
+#ifndef __REVERT_H_
+#define __REVERT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    uint64_t digest[2];
+    uint64_t revid; // plus one, so that zero marks an empty slot
+} revertSlot;
+
+typedef struct {
+    revertSlot *slots;
+    size_t capacity; // slots in use as the table, a power of two
+    size_t block;    // slots allocated
+    size_t count;
+
+    // with a radius, the table above is unused; ring[s % radius] holds the
+    // revision numbered s, and index the numbers plus one of the latest
+    // revision with each digest in the ring
+    size_t radius;
+    revertSlot *ring;
+    uint64_t *index;
+    size_t index_mask;
+    uint64_t seq; // revisions recorded
+} revertTable;
+
+/* a radius of 0 remembers every revision */
+void revert_init(revertTable *t, size_t radius);
+
+/* Records that revision revid has the given digest of at least 16 bytes.
+ * Returns true, with the id of the latest earlier revision with the same
+ * digest in *previous, if there was one.
+ */
+bool revert_record(revertTable *t, const unsigned char *digest, uint64_t revid, uint64_t *previous);
+
+/* releases the table's storage for reuse by this thread */
+void revert_free(revertTable *t);
+
+#endif
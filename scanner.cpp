@@ -0,0 +1,493 @@
+/*
+ * MediaWiki export XML scanner, see scanner.h
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "scanner.h"
+
+using namespace std;
+
+// the longest character reference we decode, e.g. &#x0010FFFF;
+#define MAX_ENTITY_LENGTH 16
+
+struct scanner {
+    void *user;
+    XML_StartElementHandler start;
+    XML_EndElementHandler end;
+    XML_CharacterDataHandler text;
+
+    // the start of a construct cut off at the end of the last buffer
+    string pending;
+    long long offset;  // of the next byte to be scanned
+    bool skip_lf;      // the last buffer ended in a CR
+
+    vector<string> open;  // the names of the open elements
+    bool root_seen;
+
+    // scratch space for start tags and decoded references
+    string name;
+    vector<string> attr_strings;
+    vector<const XML_Char*> attrs;
+    string decoded;
+
+    string error;
+    long long error_offset;
+};
+
+scanner *
+scanner_create(void *user, XML_StartElementHandler start,
+               XML_EndElementHandler end, XML_CharacterDataHandler text)
+{
+    scanner *s = new scanner;
+    s->user = user;
+    s->start = start;
+    s->end = end;
+    s->text = text;
+    s->offset = 0;
+    s->skip_lf = false;
+    s->root_seen = false;
+    s->error_offset = 0;
+    return s;
+}
+
+void
+scanner_set_character_handler(scanner *s, XML_CharacterDataHandler text)
+{
+    s->text = text;
+}
+
+const char *
+scanner_error(scanner *s)
+{
+    return s->error.c_str();
+}
+
+long long
+scanner_error_offset(scanner *s)
+{
+    return s->error_offset;
+}
+
+void
+scanner_free(scanner *s)
+{
+    delete s;
+}
+
+static bool
+fail(scanner *s, long long offset, const char *message)
+{
+    s->error = message;
+    s->error_offset = offset;
+    return false;
+}
+
+/* the index of the first '<', '&' or CR in p, or len */
+static size_t
+find_special(const char *p, size_t len)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i lt = _mm_set1_epi8('<');
+    const __m128i amp = _mm_set1_epi8('&');
+    const __m128i cr = _mm_set1_epi8('\r');
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (p + i));
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, amp)),
+                                    _mm_cmpeq_epi8(v, cr));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+#endif
+    for (; i < len; ++i) {
+        if (p[i] == '<' || p[i] == '&' || p[i] == '\r')
+            return i;
+    }
+    return len;
+}
+
+static inline bool
+is_space(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+/* passes character data to the handler; outside the root element only
+ * whitespace is allowed, and it is not reported, as with expat
+ */
+static bool
+emit_text(scanner *s, const char *p, size_t len, long long offset)
+{
+    if (len == 0)
+        return true;
+    if (s->open.empty()) {
+        for (size_t i = 0; i < len; ++i) {
+            if (!is_space(p[i]))
+                return fail(s, offset + i, "text outside the document element");
+        }
+        return true;
+    }
+    if (s->text != NULL)
+        s->text(s->user, p, (int) len);
+    return true;
+}
+
+static void
+append_utf8(string *out, unsigned long c)
+{
+    if (c < 0x80) {
+        out->push_back((char) c);
+    } else if (c < 0x800) {
+        out->push_back((char) (0xC0 | (c >> 6)));
+        out->push_back((char) (0x80 | (c & 0x3F)));
+    } else if (c < 0x10000) {
+        out->push_back((char) (0xE0 | (c >> 12)));
+        out->push_back((char) (0x80 | ((c >> 6) & 0x3F)));
+        out->push_back((char) (0x80 | (c & 0x3F)));
+    } else {
+        out->push_back((char) (0xF0 | (c >> 18)));
+        out->push_back((char) (0x80 | ((c >> 12) & 0x3F)));
+        out->push_back((char) (0x80 | ((c >> 6) & 0x3F)));
+        out->push_back((char) (0x80 | (c & 0x3F)));
+    }
+}
+
+/* Decodes the reference at p[0] == '&' onto out, returning its length, 0 if
+ * it is cut off, or -1 if it is not one we know.
+ */
+static int
+decode_entity(const char *p, size_t len, bool final, string *out)
+{
+    const char *semi = (const char*) memchr(p, ';', min(len, (size_t) MAX_ENTITY_LENGTH));
+    if (semi == NULL)
+        return (len < MAX_ENTITY_LENGTH && !final) ? 0 : -1;
+
+    const char *name = p + 1;
+    size_t n = semi - name;
+    if (n == 2 && name[0] == 'l' && name[1] == 't') {
+        out->push_back('<');
+    } else if (n == 2 && name[0] == 'g' && name[1] == 't') {
+        out->push_back('>');
+    } else if (n == 3 && memcmp(name, "amp", 3) == 0) {
+        out->push_back('&');
+    } else if (n == 4 && memcmp(name, "quot", 4) == 0) {
+        out->push_back('"');
+    } else if (n == 4 && memcmp(name, "apos", 4) == 0) {
+        out->push_back('\'');
+    } else if (n >= 2 && name[0] == '#') {
+        bool hex = name[1] == 'x';
+        const char *digits = name + (hex ? 2 : 1);
+        if (digits == semi)
+            return -1;
+        unsigned long c = 0;
+        for (const char *d = digits; d < semi; ++d) {
+            int v;
+            if (*d >= '0' && *d <= '9')
+                v = *d - '0';
+            else if (hex && *d >= 'a' && *d <= 'f')
+                v = *d - 'a' + 10;
+            else if (hex && *d >= 'A' && *d <= 'F')
+                v = *d - 'A' + 10;
+            else
+                return -1;
+            c = c * (hex ? 16 : 10) + v;
+        }
+        if (c == 0 || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF))
+            return -1;
+        append_utf8(out, c);
+    } else {
+        return -1;
+    }
+    return (int) (semi - p) + 1;
+}
+
+/* Parses the attributes of a start tag, from just after its name to just
+ * before its closing "/>" or ">", into s->attrs.
+ */
+static bool
+parse_attributes(scanner *s, const char *p, const char *end, long long offset)
+{
+    s->attr_strings.clear();
+    for (;;) {
+        while (p < end && is_space(*p))
+            ++p;
+        if (p == end)
+            break;
+        const char *name = p;
+        while (p < end && *p != '=' && !is_space(*p))
+            ++p;
+        string attr_name(name, p - name);
+        while (p < end && is_space(*p))
+            ++p;
+        if (p == end || *p != '=' || attr_name.empty())
+            return fail(s, offset, "malformed attribute");
+        ++p;
+        while (p < end && is_space(*p))
+            ++p;
+        if (p == end || (*p != '"' && *p != '\''))
+            return fail(s, offset, "malformed attribute");
+        char quote = *p++;
+        const char *close = (const char*) memchr(p, quote, end - p);
+        if (close == NULL)
+            return fail(s, offset, "malformed attribute");
+
+        // values are normalized as XML requires: references decoded,
+        // whitespace characters turned into spaces
+        string value;
+        while (p < close) {
+            if (*p == '&') {
+                int n = decode_entity(p, close - p, true, &value);
+                if (n <= 0)
+                    return fail(s, offset, "unsupported entity reference in attribute");
+                p += n;
+            } else if (*p == '<') {
+                return fail(s, offset, "malformed attribute");
+            } else if (*p == '\r') {
+                value.push_back(' ');
+                p += (p + 1 < close && p[1] == '\n') ? 2 : 1;
+            } else {
+                value.push_back(is_space(*p) ? ' ' : *p);
+                ++p;
+            }
+        }
+        p = close + 1;
+        s->attr_strings.push_back(attr_name);
+        s->attr_strings.push_back(value);
+    }
+
+    s->attrs.clear();
+    for (size_t i = 0; i < s->attr_strings.size(); ++i)
+        s->attrs.push_back(s->attr_strings[i].c_str());
+    s->attrs.push_back(NULL);
+    return true;
+}
+
+/* the end of the start tag at p, skipping quoted attribute values, or NULL */
+static const char *
+find_tag_end(const char *p, const char *end)
+{
+    char quote = 0;
+    for (; p < end; ++p) {
+        if (quote != 0) {
+            if (*p == quote)
+                quote = 0;
+        } else if (*p == '"' || *p == '\'') {
+            quote = *p;
+        } else if (*p == '>') {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* the first occurrence of the terminator t in [p, end), or NULL */
+static const char *
+find_terminator(const char *p, const char *end, const char *t)
+{
+    size_t n = strlen(t);
+    while (end - p >= (ptrdiff_t) n) {
+        const char *c = (const char*) memchr(p, t[0], end - p - n + 1);
+        if (c == NULL)
+            return NULL;
+        if (memcmp(c, t, n) == 0)
+            return c;
+        p = c + 1;
+    }
+    return NULL;
+}
+
+/* Scans the markup at p[0] == '<', returning its length, 0 if it is cut off
+ * or -1 after an error.
+ */
+static long
+scan_markup(scanner *s, const char *p, size_t len, bool final, long long offset)
+{
+    const char *end = p + len;
+    if (len < 2)
+        return final ? (fail(s, offset, "unclosed markup"), -1) : 0;
+
+    if (p[1] == '/') {
+        const char *gt = (const char*) memchr(p, '>', len);
+        if (gt == NULL)
+            return final ? (fail(s, offset, "unclosed end tag"), -1) : 0;
+        const char *name_end = gt;
+        while (name_end > p + 2 && is_space(name_end[-1]))
+            --name_end;
+        s->name.assign(p + 2, name_end - (p + 2));
+        if (s->open.empty() || s->open.back() != s->name) {
+            fail(s, offset, "mismatched tag");
+            return -1;
+        }
+        s->open.pop_back();
+        s->end(s->user, s->name.c_str());
+        return gt - p + 1;
+    }
+
+    if (p[1] == '?') {
+        const char *close = find_terminator(p + 2, end, "?>");
+        if (close == NULL)
+            return final ? (fail(s, offset, "unclosed processing instruction"), -1) : 0;
+        return close - p + 2;
+    }
+
+    if (p[1] == '!') {
+        if (len < 9 && !final)
+            return 0;
+        if (len >= 4 && memcmp(p, "<!--", 4) == 0) {
+            const char *close = find_terminator(p + 4, end, "-->");
+            if (close == NULL)
+                return final ? (fail(s, offset, "unclosed comment"), -1) : 0;
+            return close - p + 3;
+        }
+        if (len >= 9 && memcmp(p, "<![CDATA[", 9) == 0) {
+            const char *close = find_terminator(p + 9, end, "]]>");
+            if (close == NULL)
+                return final ? (fail(s, offset, "unclosed CDATA section"), -1) : 0;
+            if (s->open.empty()) {
+                fail(s, offset, "CDATA section outside the document element");
+                return -1;
+            }
+            if (s->text != NULL && close > p + 9)
+                s->text(s->user, p + 9, (int) (close - (p + 9)));
+            return close - p + 3;
+        }
+        fail(s, offset, "unsupported markup declaration");
+        return -1;
+    }
+
+    const char *gt = find_tag_end(p + 1, end);
+    if (gt == NULL)
+        return final ? (fail(s, offset, "unclosed start tag"), -1) : 0;
+    bool empty = gt[-1] == '/';
+    const char *body_end = empty ? gt - 1 : gt;
+    const char *name_end = p + 1;
+    while (name_end < body_end && !is_space(*name_end))
+        ++name_end;
+    if (name_end == p + 1) {
+        fail(s, offset, "malformed start tag");
+        return -1;
+    }
+    if (s->open.empty() && s->root_seen) {
+        fail(s, offset, "junk after document element");
+        return -1;
+    }
+    if (!parse_attributes(s, name_end, body_end, offset))
+        return -1;
+
+    s->open.push_back(string(p + 1, name_end - (p + 1)));
+    s->root_seen = true;
+    s->start(s->user, s->open.back().c_str(), &s->attrs[0]);
+    if (empty) {
+        s->name.swap(s->open.back());
+        s->open.pop_back();
+        s->end(s->user, s->name.c_str());
+    }
+    return gt - p + 1;
+}
+
+/* Scans as much of p as can be, returning the number of bytes consumed;
+ * fewer than len when a construct is cut off at the end.  Sets s->error on
+ * errors.
+ */
+static size_t
+scan(scanner *s, const char *p, size_t len, bool final, long long offset)
+{
+    size_t i = 0;
+    if (s->skip_lf && len > 0) {
+        s->skip_lf = false;
+        if (p[0] == '\n')
+            i = 1;
+    }
+
+    while (i < len) {
+        size_t j = i + find_special(p + i, len - i);
+        if (!emit_text(s, p + i, j - i, offset + i))
+            return i;
+        if (j == len)
+            return len;
+
+        if (p[j] == '\r') {
+            // line ends are normalized to LF, as XML requires
+            if (!emit_text(s, "\n", 1, offset + j))
+                return j;
+            ++j;
+            if (j == len)
+                s->skip_lf = true;
+            else if (p[j] == '\n')
+                ++j;
+            i = j;
+        } else if (p[j] == '&') {
+            s->decoded.clear();
+            int n = decode_entity(p + j, len - j, final, &s->decoded);
+            if (n == 0)
+                return j;
+            if (n < 0) {
+                fail(s, offset + j, "unsupported entity reference");
+                return j;
+            }
+            if (!emit_text(s, s->decoded.data(), s->decoded.size(), offset + j))
+                return j;
+            i = j + n;
+        } else {
+            long n = scan_markup(s, p + j, len - j, final, offset + j);
+            if (n <= 0)
+                return j;
+            i = j + n;
+        }
+    }
+    return len;
+}
+
+bool
+scanner_parse(scanner *s, const char *buf, size_t len, bool final)
+{
+    if (!s->error.empty())
+        return false;
+
+    // first complete the construct left over from the last buffer, taking
+    // from buf only up to the character which may end it
+    size_t used = 0;
+    while (!s->pending.empty()) {
+        char terminator = (s->pending[0] == '&') ? ';' : '>';
+        const char *t = (const char*) memchr(buf + used, terminator, len - used);
+        size_t take = (t != NULL) ? t - (buf + used) + 1 : len - used;
+        s->pending.append(buf + used, take);
+        used += take;
+
+        bool last = final && used == len;
+        size_t done = scan(s, s->pending.data(), s->pending.size(), last, s->offset);
+        if (!s->error.empty())
+            return false;
+        s->pending.erase(0, done);
+        s->offset += done;
+        if (used == len && !s->pending.empty()) {
+            if (last)
+                return fail(s, s->offset, "incomplete markup at the end of the document");
+            return true;
+        }
+    }
+
+    size_t done = scan(s, buf + used, len - used, final, s->offset);
+    if (!s->error.empty())
+        return false;
+    s->offset += done;
+    s->pending.assign(buf + used + done, len - used - done);
+
+    if (final) {
+        if (!s->pending.empty())
+            return fail(s, s->offset, "incomplete markup at the end of the document");
+        if (!s->root_seen)
+            return fail(s, s->offset, "no element found");
+        if (!s->open.empty())
+            return fail(s, s->offset, "unclosed element");
+    }
+    return true;
+}
@@ -0,0 +1,43 @@
+/*
+ * A fast, non-validating scanner for MediaWiki export XML.
+ *
+ * Dumps use a handful of elements, a few attributes, the predefined and
+ * numeric character references and no DTD, so they can be scanned much more
+ * cheaply than by a general XML parser: text is searched for '<', '&' and CR
+ * sixteen bytes at a time, and runs of plain text are passed to the
+ * character data handler as pointers into the caller's buffer.  The handlers
+ * are expat's, called in the order expat would call them.
+ *
+ * Anything beyond that subset (a DOCTYPE, unknown entities, mismatched tags)
+ * is reported as an error, and such input should be parsed with expat.
+ * Encoding is not checked.
+ */
+
+#ifndef __SCANNER_H_
+#define __SCANNER_H_
+
+#include <stddef.h>
+#include "expat.h"
+
+typedef struct scanner scanner;
+
+scanner *scanner_create(void *user, XML_StartElementHandler start,
+                        XML_EndElementHandler end, XML_CharacterDataHandler text);
+
+/* may be called from within a handler, as with expat */
+void scanner_set_character_handler(scanner *s, XML_CharacterDataHandler text);
+
+/* Scans the next len bytes of the document; constructs cut off at the end of
+ * buf are completed by the next call.  final marks the last call.  Returns
+ * false on an error, which scanner_error() describes.
+ */
+bool scanner_parse(scanner *s, const char *buf, size_t len, bool final);
+
+const char *scanner_error(scanner *s);
+
+/* the byte offset in the document of the construct which caused the error */
+long long scanner_error_offset(scanner *s);
+
+void scanner_free(scanner *s);
+
+#endif
@@ -0,0 +1,35 @@
+/*
+ * Element lookup table, see schema.h
+ */
+
+#include <stdlib.h>
+#include <iostream>
+#include "schema.h"
+
+using namespace std;
+
+const char *const schema_names[TAG_OTHER] = {
+#define SCHEMA_NAME(tag, name) name,
+    SCHEMA_TAGS(SCHEMA_NAME)
+#undef SCHEMA_NAME
+};
+
+unsigned char schema_table[SCHEMA_TABLE_SIZE];
+
+void
+schema_init(void)
+{
+    for (int h = 0; h < SCHEMA_TABLE_SIZE; ++h)
+        schema_table[h] = TAG_OTHER;
+
+    for (int tag = 0; tag < TAG_OTHER; ++tag) {
+        const char *name = schema_names[tag];
+        unsigned h = schema_hash(name, strlen(name));
+        if (schema_table[h] != TAG_OTHER) {
+            cerr << "schema hash collision between <" << schema_names[schema_table[h]]
+                 << "> and <" << name << ">" << endl;
+            exit(1);
+        }
+        schema_table[h] = tag;
+    }
+}
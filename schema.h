@@ -0,0 +1,72 @@
+/*
+ * The elements of the MediaWiki export schema which wikiq recognizes.
+ *
+ * Element names are resolved to a tag through a perfect hash of their first
+ * and last characters and length, which costs a single string comparison to
+ * confirm, instead of one comparison per known element.  The table is built
+ * from SCHEMA_TAGS by schema_init(), which also checks that the hash is
+ * still perfect; to recognize another element, add it to the list (and
+ * adjust schema_hash() should it collide).
+ */
+
+#ifndef __SCHEMA_H_
+#define __SCHEMA_H_
+
+#include <string.h>
+
+#define SCHEMA_TAGS(X) \
+    X(TAG_MEDIAWIKI, "mediawiki") \
+    X(TAG_SITEINFO, "siteinfo") \
+    X(TAG_PAGE, "page") \
+    X(TAG_TITLE, "title") \
+    X(TAG_NS, "ns") \
+    X(TAG_ID, "id") \
+    X(TAG_RESTRICTIONS, "restrictions") \
+    X(TAG_REVISION, "revision") \
+    X(TAG_PARENTID, "parentid") \
+    X(TAG_TIMESTAMP, "timestamp") \
+    X(TAG_CONTRIBUTOR, "contributor") \
+    X(TAG_USERNAME, "username") \
+    X(TAG_IP, "ip") \
+    X(TAG_MINOR, "minor") \
+    X(TAG_COMMENT, "comment") \
+    X(TAG_MODEL, "model") \
+    X(TAG_FORMAT, "format") \
+    X(TAG_TEXT, "text") \
+    X(TAG_SHA1, "sha1")
+
+enum schematag {
+#define SCHEMA_ENUM(tag, name) tag,
+    SCHEMA_TAGS(SCHEMA_ENUM)
+#undef SCHEMA_ENUM
+    TAG_OTHER // any element not listed above
+};
+
+#define SCHEMA_TABLE_SIZE 64
+
+extern const char *const schema_names[TAG_OTHER];
+extern unsigned char schema_table[SCHEMA_TABLE_SIZE];
+
+/* builds the lookup table; exits if two names hash alike */
+void schema_init(void);
+
+static inline unsigned
+schema_hash(const char *name, size_t len)
+{
+    return ((unsigned char) name[0] * 2 + (unsigned char) name[len - 1] * 3 + len)
+           & (SCHEMA_TABLE_SIZE - 1);
+}
+
+static inline enum schematag
+schema_lookup(const char *name)
+{
+    size_t len = strlen(name);
+    if (len == 0)
+        return TAG_OTHER;
+    enum schematag tag = (enum schematag) schema_table[schema_hash(name, len)];
+    if (tag == TAG_OTHER || strcmp(schema_names[tag], name) != 0)
+        return TAG_OTHER;
+    return tag;
+}
+
+#endif
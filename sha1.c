@@ -0,0 +1,149 @@
+/*
+  Implementation of SHA-1 (FIPS 180-4), see sha1.h
+ */
+
+#include "sha1.h"
+#include <string.h>
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void
+sha1_process(sha1_state_t *pms, const sha1_byte_t *data /*[64]*/)
+{
+    sha1_word_t w[80];
+    sha1_word_t a = pms->h[0], b = pms->h[1], c = pms->h[2], d = pms->h[3], e = pms->h[4];
+    int i;
+
+    for (i = 0; i < 16; ++i)
+	w[i] = ((sha1_word_t)data[i * 4] << 24) | ((sha1_word_t)data[i * 4 + 1] << 16) |
+	    ((sha1_word_t)data[i * 4 + 2] << 8) | data[i * 4 + 3];
+    for (; i < 80; ++i)
+	w[i] = ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    for (i = 0; i < 80; ++i) {
+	sha1_word_t f, k, t;
+	if (i < 20) {
+	    f = (b & c) | (~b & d);
+	    k = 0x5A827999;
+	} else if (i < 40) {
+	    f = b ^ c ^ d;
+	    k = 0x6ED9EBA1;
+	} else if (i < 60) {
+	    f = (b & c) | (b & d) | (c & d);
+	    k = 0x8F1BBCDC;
+	} else {
+	    f = b ^ c ^ d;
+	    k = 0xCA62C1D6;
+	}
+	t = ROL(a, 5) + f + e + k + w[i];
+	e = d;
+	d = c;
+	c = ROL(b, 30);
+	b = a;
+	a = t;
+    }
+
+    pms->h[0] += a;
+    pms->h[1] += b;
+    pms->h[2] += c;
+    pms->h[3] += d;
+    pms->h[4] += e;
+}
+
+void
+sha1_init(sha1_state_t *pms)
+{
+    pms->count[0] = pms->count[1] = 0;
+    pms->h[0] = 0x67452301;
+    pms->h[1] = 0xEFCDAB89;
+    pms->h[2] = 0x98BADCFE;
+    pms->h[3] = 0x10325476;
+    pms->h[4] = 0xC3D2E1F0;
+}
+
+void
+sha1_append(sha1_state_t *pms, const sha1_byte_t *data, int nbytes)
+{
+    const sha1_byte_t *p = data;
+    int left = nbytes;
+    int offset = pms->count[0] & 63;
+
+    if (nbytes <= 0)
+	return;
+
+    /* Update the message length. */
+    pms->count[0] += nbytes;
+    if (pms->count[0] < (sha1_word_t)nbytes)
+	pms->count[1]++;
+
+    /* Process an initial partial block. */
+    if (offset) {
+	int copy = (offset + nbytes > 64 ? 64 - offset : nbytes);
+
+	memcpy(pms->buf + offset, p, copy);
+	if (offset + copy < 64)
+	    return;
+	p += copy;
+	left -= copy;
+	sha1_process(pms, pms->buf);
+    }
+
+    /* Process full blocks. */
+    for (; left >= 64; p += 64, left -= 64)
+	sha1_process(pms, p);
+
+    /* Process a final partial block. */
+    if (left)
+	memcpy(pms->buf, p, left);
+}
+
+void
+sha1_finish(sha1_state_t *pms, sha1_byte_t digest[20])
+{
+    static const sha1_byte_t pad[64] = { 0x80 };
+    sha1_byte_t data[8];
+    sha1_word_t hi = (pms->count[1] << 3) | (pms->count[0] >> 29);
+    sha1_word_t lo = pms->count[0] << 3;
+    int i;
+
+    /* Save the length before padding, in bits, big-endian. */
+    for (i = 0; i < 4; ++i) {
+	data[i] = (sha1_byte_t)(hi >> (24 - i * 8));
+	data[i + 4] = (sha1_byte_t)(lo >> (24 - i * 8));
+    }
+    /* Pad to 56 bytes mod 64. */
+    sha1_append(pms, pad, ((55 - (pms->count[0] & 63)) & 63) + 1);
+    /* Append the length. */
+    sha1_append(pms, data, 8);
+    for (i = 0; i < 20; ++i)
+	digest[i] = (sha1_byte_t)(pms->h[i >> 2] >> (24 - (i & 3) * 8));
+}
+
+int
+sha1_from_base36(const char *base36, int len, sha1_byte_t digest[20])
+{
+    int i, j;
+
+    if (len <= 0 || len > 31)
+	return 0;
+    memset(digest, 0, 20);
+    for (i = 0; i < len; ++i) {
+	char c = base36[i];
+	unsigned int carry;
+	if (c >= '0' && c <= '9')
+	    carry = c - '0';
+	else if (c >= 'a' && c <= 'z')
+	    carry = c - 'a' + 10;
+	else
+	    return 0;
+	/* digest = digest * 36 + digit, big-endian */
+	for (j = 19; j >= 0; --j) {
+	    carry += digest[j] * 36;
+	    digest[j] = (sha1_byte_t)(carry & 0xff);
+	    carry >>= 8;
+	}
+	if (carry)
+	    return 0;
+    }
+    return 1;
+}
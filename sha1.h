@@ -0,0 +1,43 @@
+/*
+  Implementation of SHA-1 (FIPS 180-4), with the same interface as md5.h.
+
+  MediaWiki dumps carry the SHA-1 of each revision's text in base36, see
+  sha1_from_base36(); the digest is computed only where it is missing.
+ */
+
+#ifndef sha1_INCLUDED
+#  define sha1_INCLUDED
+
+typedef unsigned char sha1_byte_t; /* 8-bit byte */
+typedef unsigned int sha1_word_t; /* 32-bit word */
+
+/* Define the state of the SHA-1 Algorithm. */
+typedef struct sha1_state_s {
+    sha1_word_t count[2];	/* message length in bytes, lsw first */
+    sha1_word_t h[5];		/* digest buffer */
+    sha1_byte_t buf[64];	/* accumulate block */
+} sha1_state_t;
+
+#ifdef __cplusplus
+extern "C" 
+{
+#endif
+
+/* Initialize the algorithm. */
+void sha1_init(sha1_state_t *pms);
+
+/* Append a string to the message. */
+void sha1_append(sha1_state_t *pms, const sha1_byte_t *data, int nbytes);
+
+/* Finish the message and return the digest. */
+void sha1_finish(sha1_state_t *pms, sha1_byte_t digest[20]);
+
+/* Decodes the base36 form of a digest used by MediaWiki (up to 31 digits
+   and lowercase letters) into digest; returns 0 if it is not one. */
+int sha1_from_base36(const char *base36, int len, sha1_byte_t digest[20]);
+
+#ifdef __cplusplus
+}  /* end extern "C" */
+#endif
+
+#endif /* sha1_INCLUDED */
@@ -0,0 +1,136 @@
+/*
+ * Token interning, see tokens.h
+ */
+
+#include <string.h>
+#include <algorithm>
+#include "tokens.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+#define TOKEN_INITIAL_CAPACITY 1024
+
+// FNV-1a
+static uint32_t
+hash_token(const char *data, size_t size)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+void
+token_table_clear(tokenTable *t)
+{
+    if (t->slots.empty()) {
+        t->slots.resize(TOKEN_INITIAL_CAPACITY);
+        t->mask = TOKEN_INITIAL_CAPACITY - 1;
+    } else if (t->spans.size() * 8 < t->slots.size()) {
+        // a table grown by a large diff is mostly empty for small ones
+        for (size_t id = 0; id < t->spans.size(); ++id) {
+            size_t i = t->spans[id].hash & t->mask;
+            while (t->slots[i] != id + 1) {
+                i = (i + 1) & t->mask;
+            }
+            t->slots[i] = 0;
+        }
+    } else {
+        fill(t->slots.begin(), t->slots.end(), 0);
+    }
+    t->spans.clear();
+}
+
+/* doubles the table, which is kept at most half full */
+static void
+grow(tokenTable *t)
+{
+    t->slots.assign(t->slots.size() * 2, 0);
+    t->mask = t->slots.size() - 1;
+    for (uint32_t id = 0; id < t->spans.size(); ++id) {
+        size_t i = t->spans[id].hash & t->mask;
+        while (t->slots[i] != 0) {
+            i = (i + 1) & t->mask;
+        }
+        t->slots[i] = id + 1;
+    }
+}
+
+uint32_t
+token_intern(tokenTable *t, const char *data, size_t size)
+{
+    uint32_t h = hash_token(data, size);
+    size_t i = h & t->mask;
+    for (; t->slots[i] != 0; i = (i + 1) & t->mask) {
+        const tokenSpan& s = t->spans[t->slots[i] - 1];
+        if (s.hash == h && s.size == size && memcmp(s.data, data, size) == 0) {
+            return t->slots[i] - 1;
+        }
+    }
+
+    uint32_t id = t->spans.size();
+    tokenSpan s = { data, size, h };
+    t->spans.push_back(s);
+    t->slots[i] = id + 1;
+    if (t->spans.size() * 2 > t->slots.size()) {
+        grow(t);
+    }
+    return id;
+}
+
+#ifdef __SSE2__
+/* a bit for each of the 32 bytes at p which is one of TOKEN_BREAKS */
+static inline uint32_t
+break_mask(const char *p)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i cr = _mm_set1_epi8('\r');
+    __m128i lo = _mm_loadu_si128((const __m128i*) p);
+    __m128i hi = _mm_loadu_si128((const __m128i*) (p + 16));
+    __m128i lo_breaks = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(lo, space), _mm_cmpeq_epi8(lo, newline)),
+                                     _mm_or_si128(_mm_cmpeq_epi8(lo, tab), _mm_cmpeq_epi8(lo, cr)));
+    __m128i hi_breaks = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(hi, space), _mm_cmpeq_epi8(hi, newline)),
+                                     _mm_or_si128(_mm_cmpeq_epi8(hi, tab), _mm_cmpeq_epi8(hi, cr)));
+    return (uint32_t) _mm_movemask_epi8(lo_breaks) | ((uint32_t) _mm_movemask_epi8(hi_breaks) << 16);
+}
+#endif
+
+/* The breaks are found 32 bytes at a time, and each token is interned as the
+ * span between two of them, so nothing is copied out of the text.
+ */
+void
+tokenize(tokenTable *t, const string& text, size_t start, size_t end, vector<uint32_t> *ids)
+{
+    const char *data = text.data();
+    size_t i = (start == 0) ? 0 : start + 1;
+#ifdef __SSE2__
+    for (; i + 32 <= end; i += 32) {
+        for (uint32_t mask = break_mask(data + i); mask != 0; mask &= mask - 1) {
+            size_t b = i + __builtin_ctz(mask);
+            ids->push_back(token_intern(t, data + start, b - start));
+            start = b;
+        }
+    }
+#endif
+
+    bool token_break[256];
+    memset(token_break, 0, sizeof(token_break));
+    for (const char *c = TOKEN_BREAKS; *c != '\0'; ++c) {
+        token_break[(unsigned char) *c] = true;
+    }
+
+    const unsigned char *p = (const unsigned char *) data;
+    for (; i < end; ++i) {
+        if (token_break[p[i]]) {
+            ids->push_back(token_intern(t, data + start, i - start));
+            start = i;
+        }
+    }
+}
@@ -0,0 +1,53 @@
+/*
+ * The tokens which revision texts are diffed in.
+ *
+ * A token runs from a token break up to the next one, so the breaks start
+ * tokens; text after the last break is not a token.  Tokens are interned as
+ * 32-bit ids in a flat, linearly probed hash table, so that a diff compares
+ * integers, and each id keeps the span of text it was first seen at, from
+ * which the additions and deletions are put back together.  Spans point into
+ * the texts, which must outlive the table's use.
+ */
+
+#ifndef __TOKENS_H_
+#define __TOKENS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// the characters which start a new token, also matched by tokenize() itself
+#define TOKEN_BREAKS " \n\t\r"
+
+typedef struct {
+    const char *data;
+    size_t size;
+    uint32_t hash;
+} tokenSpan;
+
+typedef struct {
+    std::vector<uint32_t> slots;  // ids plus one, so that zero marks an empty slot
+    std::vector<tokenSpan> spans; // of each id
+    size_t mask;
+} tokenTable;
+
+/* empties the table, keeping its storage for reuse */
+void token_table_clear(tokenTable *t);
+
+/* the id of the size bytes at data, which is given to new tokens in order */
+uint32_t token_intern(tokenTable *t, const char *data, size_t size);
+
+inline const tokenSpan&
+token_span(const tokenTable *t, uint32_t id)
+{
+    return t->spans[id];
+}
+
+/* Appends the ids of the tokens of text which start at start, either 0 or a
+ * token break, and end at token breaks before end.
+ */
+void tokenize(tokenTable *t, const std::string& text, size_t start, size_t end,
+              std::vector<uint32_t> *ids);
+
+#endif
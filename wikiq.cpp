@@ -11,12 +11,32 @@
 #include <stdlib.h>
 #include "expat.h"
 #include <getopt.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "disorder.h"
 #include "md5.h"
-#include "dtl/dtl.hpp"
+#include "sha1.h"
 #include <vector>
 #include <map>
+#include <set>
+#include <sstream>
 #include <pcrecpp.h>
+#include "pipeline.h"
+#include "input.h"
+#include "multistream.h"
+#include "scanner.h"
+#include "schema.h"
+#include "revert.h"
+#include "tokens.h"
+#include "diff.h"
+#include "diffcache.h"
+#include "workspace.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 
 using namespace std;
@@ -29,23 +49,121 @@ using namespace std;
 #define MEGABYTE 1048576
 #define FIELD_BUFFER_SIZE 1024
 
-// this can be changed at runtime if we encounter an article larger than 10mb
-size_t text_buffer_size = 10 * MEGABYTE;
+// revisions of a page are handed to the workers in chunks of about this much text
+#define CHUNK_TEXT_SIZE (16 * MEGABYTE)
+// per worker thread, the amount of text which may be queued or awaiting output
+#define INFLIGHT_TEXT_PER_THREAD (64 * MEGABYTE)
+// windows with less text than this are diffed on the calling thread
+#define WINDOW_THREADING_TEXT_SIZE MEGABYTE
+// memory-mapped shards are handed to expat in pieces of this size
+#define SHARD_PARSE_SIZE (16 * MEGABYTE)
+// streamed input is read straight into expat's buffer this much at a time,
+// unless changed with -b
+#define READ_SIZE (4 * MEGABYTE)
+
+// revision text is scanned in blocks of this size, small enough to stay in
+// the L1 cache while each statistic is taken of it; a multiple of the MD5
+// and SHA-1 block size
+#define TEXT_BLOCK_SIZE (16 * 1024)
+
+// the initial size of the text buffer, which grows for larger revisions
+#define TEXT_BUFFER_SIZE (10 * MEGABYTE)
 
 enum elements { 
     TITLE, ARTICLEID, REVISION, REVID, TIMESTAMP, CONTRIBUTOR, 
-    EDITOR, EDITORID, MINOR, COMMENT, UNUSED, TEXT
+    EDITOR, EDITORID, MINOR, COMMENT, UNUSED, TEXT, NAMESPACE, SHA1
 }; 
 
 enum block { TITLE_BLOCK, REVISION_BLOCK, CONTRIBUTOR_BLOCK, SKIP };
 
 enum outtype { FULL, SIMPLE };
 
+// options which are fixed after argument parsing, shared by all threads
+typedef struct {
+    vector<pcrecpp::RE> regexes;
+    vector<pcrecpp::RE> wp_namespace_res;
+    vector<string> regex_names;
+    enum outtype output_type;
+    int threads;
+    size_t window; // revisions of a page diffed concurrently
+    set<unsigned long> page_ids; // if not empty, only these pages are processed
+    set<long> namespaces;        // likewise for the pages' <ns>
+    bool dump_sha1;              // digests are the dump's <sha1>, not computed MD5s
+    size_t revert_radius;        // reverts are detected this far back, 0 for all the way
+    bool incremental_entropy;    // byte frequencies are updated from the diffs
+    bool trim_suffix;            // text common to the end of both revisions is not diffed
+    enum diffengine diff_engine;
+    size_t linear_tokens;        // diffs of more tokens are taken in linear space, if not 0
+    long long diff_budget;       // diffs needing more differences are approximated, if not 0
+    bool line_diff;              // lines are diffed before the tokens of changed ones
+    size_t diff_cache_size;      // bytes of diffs kept per article, see -C, 0 for none
+} wikiqConfig;
+
+wikiqConfig config;
+
+
+// a completed revision, copied out of the parser's buffers
+typedef struct {
+    string revid;
+    string date;
+    string time;
+    string editor;
+    string editorid;
+    string comment;
+    string text;
+    string sha1; // base36, as given in the dump with -s
+    bool minor;
+} revision;
+
+// per-article state, carried from each revision to the next
+typedef struct {
+    string title;
+    string articleid;
+    string last_text; // of the last revision, which the next is diffed against
+    revertTable reverts; // used for detecting reversions
+
+    // with -E, the byte frequencies of the last revision's tokens, that is
+    // of its text up to its last token break
+    int token_freqs[LIBDO_MAX_BYTES];
+    bool token_freqs_valid;
+
+    // with -C, the diffs taken so far, and the digest of the last revision
+    diffCache diffs;
+    unsigned char last_digest[20];
+    bool last_digest_valid;
+} articleData;
+
+// what is computed for a revision before its row can be written
+typedef struct {
+    unsigned char digest[20];    // MD5, or SHA-1 with -s
+    char digest_hex[2 * 20 + 1];
+    int byte_freqs[LIBDO_MAX_BYTES]; // for the entropy; with -E, set by write_row()
+    string additions;
+    string deletions;
+    bool token_diff; // additions and deletions are the tokens changed
+    bool approximate; // the diff was over budget, see diff_tokens_by_count()
+    vector<bool> regex_matches_adds;
+    vector<bool> regex_matches_dels;
+
+    // with -C, the diff is expected to be in the cache by the time it is
+    // looked up, so it is not taken along with the rest of its window
+    bool cached;
+} revisionResult;
+
+// a run of consecutive revisions of one article, the unit of work
+typedef struct {
+    articleData *article;
+    vector<revision> revisions;
+    size_t text_size;
+    bool last; // the final chunk of its article, which frees the article
+} revisionChunk;
+
 typedef struct {
 
     // pointers to once-allocated buffers
     char *title;
     char *articleid;
+    char *ns;
     char *revid;
     char *date;
     char *time;
@@ -55,16 +173,13 @@ typedef struct {
     char *editorid;
     char *comment;
     char *text;
-    vector<string> last_text_tokens;
-    vector<pcrecpp::RE> regexes;
-    vector<pcrecpp::RE> wp_namespace_res;
-    vector<string> regex_names;
-    map<string, string> revision_md5; // used for detecting reversions
+    char *sha1;
 
     // track string size of the elements, to prevent O(N^2) processing in charhndl
     // when we have to take strlen for every character which we append to the buffer
     size_t title_size;
     size_t articleid_size;
+    size_t ns_size;
     size_t revid_size;
     size_t date_size;
     size_t time_size;
@@ -74,12 +189,28 @@ typedef struct {
     size_t editorid_size;
     size_t comment_size;
     size_t text_size;
+    size_t sha1_size;
+
+    // allocated for text, per parser, as each -m shard has its own
+    size_t text_capacity;
 
     bool minor;
     
     enum elements element;
     enum block position;
-    enum outtype output_type;
+
+    // the article being parsed and its chunk of revisions awaiting processing
+    articleData *article;
+    revisionChunk *chunk;
+
+    // where completed chunks go; with no pipeline they are processed inline
+    pipeline *pipe;
+    FILE *out;
+
+    // the character data handler is detached while skipping a page; scan
+    // is set instead of parser when the -S scanner parses the input
+    XML_Parser parser;
+    scanner *scan;
     
 } revisionData;
 
@@ -96,8 +227,10 @@ clean_data(revisionData *data, int title)
     if (title) {
         data->title[0] = '\0';
         data->articleid[0] = '\0';
+        data->ns[0] = '\0';
         data->title_size = 0;
         data->articleid_size = 0;
+        data->ns_size = 0;
     }
 
     // reset text fields
@@ -110,6 +243,7 @@ clean_data(revisionData *data, int title)
     data->editorid[0] = '\0';
     data->comment[0] = '\0';
     data->text[0] = '\0';
+    data->sha1[0] = '\0';
 
     // reset length tracking
     data->revid_size = 0;
@@ -121,6 +255,7 @@ clean_data(revisionData *data, int title)
     data->editorid_size = 0;
     data->comment_size = 0;
     data->text_size = 0;
+    data->sha1_size = 0;
 
     // reset flags and element type info
     data->minor = false;
@@ -136,6 +271,7 @@ free_data(revisionData *data, int title)
         //printf("freeing article\n");
         free(data->title);
         free(data->articleid);
+        free(data->ns);
     }
     free(data->revid);
     free(data->date);
@@ -146,7 +282,7 @@ free_data(revisionData *data, int title)
     free(data->editorid);
     free(data->comment);
     free(data->text);
-    data->last_text_tokens.clear();
+    free(data->sha1);
 }
 
 void cleanup_revision(revisionData *data) {
@@ -155,18 +291,19 @@ void cleanup_revision(revisionData *data) {
 
 void cleanup_article(revisionData *data) {
     clean_data(data, 1);
-    data->last_text_tokens.clear();
-    data->revision_md5.clear();
+    data->article = NULL;
 }
 
 
 static void 
-init_data(revisionData *data, outtype output_type)
+init_data(revisionData *data, pipeline *pipe, FILE *out)
 {
-    data->text = (char*) malloc(text_buffer_size);
+    data->text = (char*) malloc(TEXT_BUFFER_SIZE);
+    data->text_capacity = TEXT_BUFFER_SIZE;
     data->comment = (char*) malloc(FIELD_BUFFER_SIZE);
     data->title = (char*) malloc(FIELD_BUFFER_SIZE);
     data->articleid = (char*) malloc(FIELD_BUFFER_SIZE);
+    data->ns = (char*) malloc(FIELD_BUFFER_SIZE);
     data->revid = (char*) malloc(FIELD_BUFFER_SIZE);
     data->date = (char*) malloc(FIELD_BUFFER_SIZE);
     data->time = (char*) malloc(FIELD_BUFFER_SIZE);
@@ -174,12 +311,18 @@ init_data(revisionData *data, outtype output_type)
     data->anon = (char*) malloc(FIELD_BUFFER_SIZE);
     data->editor = (char*) malloc(FIELD_BUFFER_SIZE);
     data->editorid = (char*) malloc(FIELD_BUFFER_SIZE);
+    data->sha1 = (char*) malloc(FIELD_BUFFER_SIZE);
     data->minor = false;
+    data->position = TITLE_BLOCK;
+    data->article = NULL;
+    data->chunk = NULL;
+    data->pipe = pipe;
+    data->out = out;
+    data->parser = NULL;
+    data->scan = NULL;
 
     // resets the data fields, null terminates strings, sets lengths
     clean_data(data, 1);
-
-    data->output_type = output_type;
 }
 
 /* for debugging only, prints out the state of the data struct
@@ -188,7 +331,6 @@ static void
 print_state(revisionData *data) 
 {
     printf("element = %i\n", data->element);
-    printf("output_type = %i\n", data->output_type);
     printf("title = %s\n", data->title);
     printf("articleid = %s\n", data->articleid);
     printf("revid = %s\n", data->revid);
@@ -205,99 +347,367 @@ print_state(revisionData *data)
 }
 
 
-/* 
- * write a line of comma-separated value formatted data to standard out
- * follows the form:
- * title,articleid,revid,date,time,anon,editor,editorid,minor,comment
- * (str)  (int)    (int) (str)(str)(bin)(str)   (int)   (bin) (str)
- *
- * it is called right before cleanup_revision() and cleanup_article()
+/* Takes the statistics of a text which depend on all of it in a single pass
+ * over it: its digest (by whichever of md5 and sha1 is not NULL) and its byte
+ * frequencies (unless byte_freqs is NULL).  The text is processed a
+ * cache-sized block at a time, so that each byte is read from memory once.
+ */
+static void
+scan_text(const string& text, md5_state_t *md5, sha1_state_t *sha1, int *byte_freqs)
+{
+    disorder_ctx freqs;
+    disorder_reset(&freqs);
+
+    const unsigned char *p = (const unsigned char *) text.data();
+    for (size_t block = 0; block < text.size(); block += TEXT_BLOCK_SIZE) {
+        size_t end = min(block + TEXT_BLOCK_SIZE, text.size());
+        if (md5 != NULL) {
+            md5_append(md5, p + block, end - block);
+        }
+        if (sha1 != NULL) {
+            sha1_append(sha1, p + block, end - block);
+        }
+        if (byte_freqs != NULL) {
+            disorder_add(&freqs, (const char *) p + block, end - block);
+        }
+    }
+    if (byte_freqs != NULL) {
+        disorder_freqs(&freqs, byte_freqs);
+    }
+}
+
+/* the number of bytes which a and b, both at least len long, start with in
+ * common, compared sixteen at a time
+ */
+static size_t
+common_prefix(const char *a, const char *b, size_t len)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= len; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*) (a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*) (b + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ^ 0xffff;
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+#endif
+    for (; i < len && a[i] == b[i]; ++i)
+        ;
+    return i;
+}
+
+/* likewise for the bytes which end at a_end and b_end, up to len of them */
+static size_t
+common_suffix(const char *a_end, const char *b_end, size_t len)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= len; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*) (a_end - i - 16));
+        __m128i vb = _mm_loadu_si128((const __m128i*) (b_end - i - 16));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ^ 0xffff;
+        if (mask != 0)
+            return i + __builtin_clz(mask) - 16;
+    }
+#endif
+    for (; i < len && a_end[-1 - i] == b_end[-1 - i]; ++i)
+        ;
+    return i;
+}
+
+/* hashes a revision's text and counts its bytes; depends on nothing but the
+ * text
  */
 static void
-write_row(revisionData *data)
+analyze_revision(revision *rev, revisionResult *result)
 {
 
-    // get md5sum
-    md5_state_t state;
-    md5_byte_t digest[16];
-    char md5_hex_output[2 * 16 + 1];
-    md5_init(&state);
-    md5_append(&state, (const md5_byte_t *)data->text, data->text_size);
-    md5_finish(&state, digest);
+    unsigned char *digest = result->digest;
+    int digest_size;
+    md5_state_t md5;
+    sha1_state_t sha1;
+    int *byte_freqs = config.incremental_entropy ? NULL : result->byte_freqs;
+    if (config.dump_sha1) {
+        // the dump's own digest, computed only for revisions lacking one
+        digest_size = 20;
+        bool in_dump = sha1_from_base36(rev->sha1.data(), rev->sha1.size(), digest);
+        sha1_init(&sha1);
+        scan_text(rev->text, NULL, in_dump ? NULL : &sha1, byte_freqs);
+        if (!in_dump) {
+            sha1_finish(&sha1, digest);
+        }
+    } else {
+        // get md5sum
+        md5_init(&md5);
+        scan_text(rev->text, &md5, NULL, byte_freqs);
+        md5_finish(&md5, digest);
+        digest_size = 16;
+    }
     int di;
-    for (di = 0; di < 16; ++di) {
-        sprintf(md5_hex_output + di * 2, "%02x", digest[di]);
+    for (di = 0; di < digest_size; ++di) {
+        sprintf(result->digest_hex + di * 2, "%02x", digest[di]);
+    }
+}
+
+// appends the text of the tokens which a diff adds and deletes as the edit
+// script is recorded, so that the script itself is never stored
+class tokenChanges : public diffVisitor {
+public:
+    const tokenTable *table;
+    string *additions;
+    string *deletions;
+
+    void operator() (const uint32_t& id, const dtl::elemInfo& info) {
+        const tokenSpan& token = token_span(table, id);
+        switch (info.type) {
+        case dtl::SES_ADD:
+            additions->append(token.data, token.size);
+            break;
+        case dtl::SES_DELETE:
+            deletions->append(token.data, token.size);
+            break;
+        }
     }
+};
+
+// marks the lines which a diff of lines deletes and adds
+class lineChanges : public diffVisitor {
+public:
+    vector<bool> *deleted;
+    vector<bool> *added;
+
+    void operator() (const uint32_t&, const dtl::elemInfo& info) {
+        if (info.type == dtl::SES_DELETE) {
+            (*deleted)[info.beforeIdx - 1] = true;
+        } else if (info.type == dtl::SES_ADD) {
+            (*added)[info.beforeIdx - 1] = true;
+        }
+    }
+};
+
+// the buffers of the diffs of revisions, one per thread, see workspace.h
+typedef struct {
+    tokenTable table;
+    vector<uint32_t> last_tokens;
+    vector<uint32_t> tokens;
+
+    // with -H, the lines of both texts interned like tokens, where each
+    // starts, and which of them the diff of lines changed
+    tokenTable line_table;
+    vector<uint32_t> last_lines;
+    vector<uint32_t> lines;
+    vector<size_t> last_line_starts;
+    vector<size_t> line_starts;
+    vector<bool> lines_deleted;
+    vector<bool> lines_added;
+} diffWorkspace;
+
+static bool
+starts_with_break(const string& text)
+{
+    return !text.empty() && strchr(TOKEN_BREAKS, text[0]) != NULL;
+}
 
-    string reverted_to;
-    map<string, string>::iterator prev_revision = data->revision_md5.find(md5_hex_output);
-    if (prev_revision != data->revision_md5.end()) {
-        reverted_to = prev_revision->second; // id of previous revision
+/* the engine for a diff of this many tokens (or lines) */
+static enum diffengine
+diff_engine(size_t tokens)
+{
+    if (config.diff_engine == DIFF_ONP && config.linear_tokens > 0 && tokens > config.linear_tokens) {
+        return DIFF_LINEAR;
     }
-    data->revision_md5[md5_hex_output] = data->revid;
+    return config.diff_engine;
+}
 
-    string text = string(data->text, data->text_size);
-    vector<string> text_tokens;
-    size_t pos = 0;
-    size_t start = 0;
-    while ((pos = text.find_first_of(" \n\t\r", pos)) != string::npos) {
-        //cout << "\"\"\"" << text.substr(start, pos - start) << "\"\"\"" << endl;
-        text_tokens.push_back(text.substr(start, pos - start));
-        start = pos;
-        ++pos;
+/* diffs two sequences of token ids, appending the changes; a diff over
+ * budget is approximated, see -B
+ */
+static void
+diff_token_ids(const vector<uint32_t>& last_tokens, const vector<uint32_t>& tokens,
+               tokenChanges *changes, revisionResult *result)
+{
+    if (last_tokens.empty() && tokens.empty()) {
+        return;
+    }
+    size_t additions_size = changes->additions->size();
+    size_t deletions_size = changes->deletions->size();
+    if (!diff_tokens(diff_engine(last_tokens.size() + tokens.size()),
+                     last_tokens, tokens, config.diff_budget, changes)) {
+        changes->additions->resize(additions_size);
+        changes->deletions->resize(deletions_size);
+        diff_tokens_by_count(last_tokens, tokens, changes);
+        result->approximate = true;
     }
+}
 
-    // skip this if the wp_namespace is not in the proscribed list of
-    // namespaces
-    bool wp_namespace_found = false;
-    if (!data->wp_namespace_res.empty()) {
-        for (vector<pcrecpp::RE>::iterator r = data->wp_namespace_res.begin(); r != data->wp_namespace_res.end(); ++r) {
-            pcrecpp::RE& wp_namespace_re = *r;
-            if (wp_namespace_re.PartialMatch(data->title)) {
-                wp_namespace_found = true;
-                break;
-            }
+/* Splits the tokens of text which start at start, a token break other than
+ * one at 0, and end at token breaks before end into lines, each running from
+ * one newline breaking tokens to the next.  Appends the lines as ids, and
+ * where each starts, followed by where the last one ends.
+ */
+static void
+split_lines(tokenTable *table, const string& text, size_t start, size_t end,
+            vector<uint32_t> *lines, vector<size_t> *starts)
+{
+    size_t tokens_end = (end > start + 1) ? text.find_last_of(TOKEN_BREAKS, end - 1) : start;
+    if (tokens_end == string::npos || tokens_end <= start) {
+        return;
+    }
+    starts->push_back(start);
+    for (size_t i = text.find('\n', start + 1); i < tokens_end; i = text.find('\n', i + 1)) {
+        lines->push_back(token_intern(table, text.data() + starts->back(), i - starts->back()));
+        starts->push_back(i);
+    }
+    lines->push_back(token_intern(table, text.data() + starts->back(), tokens_end - starts->back()));
+    starts->push_back(tokens_end);
+}
+
+/* Diffs last_text[start, last_end) and text[start, end) as -H does: a line
+ * at a time first, then by tokens only within each run of changed lines.
+ * Where the flat diff of the tokens changes whole lines or parts of lines
+ * between unchanged ones, this is the same diff.
+ */
+static void
+diff_lines(diffWorkspace *workspace, const string& last_text, const string& text,
+           size_t start, size_t last_end, size_t end, tokenChanges *changes,
+           revisionResult *result)
+{
+    vector<uint32_t>& last_lines = workspace->last_lines;
+    vector<uint32_t>& lines = workspace->lines;
+    vector<size_t>& last_starts = workspace->last_line_starts;
+    vector<size_t>& starts = workspace->line_starts;
+    token_table_clear(&workspace->line_table);
+    last_lines.clear();
+    lines.clear();
+    last_starts.clear();
+    starts.clear();
+    split_lines(&workspace->line_table, last_text, start, last_end, &last_lines, &last_starts);
+    split_lines(&workspace->line_table, text, start, end, &lines, &starts);
+
+    vector<bool>& deleted = workspace->lines_deleted;
+    vector<bool>& added = workspace->lines_added;
+    deleted.assign(last_lines.size(), false);
+    added.assign(lines.size(), false);
+    lineChanges marks;
+    marks.deleted = &deleted;
+    marks.added = &added;
+    // lines are anchored at rare ones, as blank lines would misalign changed
+    // blocks; there are far fewer lines than tokens, so -B bounds only the
+    // diffs of the tokens of each block
+    diff_tokens(DIFF_HISTOGRAM, last_lines, lines, 0, &marks);
+
+    // runs of changed lines lie between pairs of unchanged ones
+    vector<uint32_t>& last_tokens = workspace->last_tokens;
+    vector<uint32_t>& tokens = workspace->tokens;
+    size_t i = 0, j = 0;
+    while (i < last_lines.size() || j < lines.size()) {
+        size_t last_run = i, run = j;
+        while (last_run < last_lines.size() && deleted[last_run]) {
+            ++last_run;
         }
-        if (!wp_namespace_found) {
-            return;
+        while (run < lines.size() && added[run]) {
+            ++run;
         }
+        if (last_run == i && run == j) {
+            ++i;
+            ++j;
+            continue;
+        }
+        last_tokens.clear();
+        tokens.clear();
+        if (last_run > i) {
+            tokenize(&workspace->table, last_text, last_starts[i], last_starts[last_run] + 1, &last_tokens);
+        }
+        if (run > j) {
+            tokenize(&workspace->table, text, starts[j], starts[run] + 1, &tokens);
+        }
+        diff_token_ids(last_tokens, tokens, changes, result);
+        i = last_run;
+        j = run;
     }
+}
 
+/* diffs a revision against the tokens of the text before it and runs the
+ * regexes over the additions and deletions; depends only on the two revisions
+ *
+ * The tokens which both texts start with are left out of the diff, which
+ * always matches them up anyway, so only the text from the last token break
+ * within their common prefix on is tokenized.  With -T the tokens they end
+ * with are left out as well.
+ */
+static void
+diff_revision(const string& last_text, revision *rev, revisionResult *result)
+{
     //vector<string> additions;
     //vector<string> deletions;
-    string additions;
-    string deletions;
-
-    vector<bool> regex_matches_adds;
-    vector<bool> regex_matches_dels;
-
-    if (data->last_text_tokens.empty()) {
-        additions = data->text;
+    string& additions = result->additions;
+    string& deletions = result->deletions;
+    additions.clear();
+    deletions.clear();
+
+    vector<bool>& regex_matches_adds = result->regex_matches_adds;
+    vector<bool>& regex_matches_dels = result->regex_matches_dels;
+    regex_matches_adds.clear();
+    regex_matches_dels.clear();
+
+    const string& text = rev->text;
+    // a text without token breaks has no tokens
+    result->token_diff = last_text.find_first_of(TOKEN_BREAKS) != string::npos;
+    result->approximate = false;
+    if (!result->token_diff) {
+        additions = text;
     } else {
-        // do the diff
-        
-        dtl::Diff< string, vector<string> > d(data->last_text_tokens, text_tokens);
-        //d.onOnlyEditDistance();
-        d.compose();
+        size_t common = min(last_text.size(), text.size());
+        size_t prefix = common_prefix(last_text.data(), text.data(), common);
+        // the break closing the last token within the prefix; a break at 0
+        // closes only an empty token, which is simply diffed
+        size_t start = (prefix > 1) ? last_text.find_last_of(TOKEN_BREAKS, prefix - 1) : 0;
+        if (start == string::npos) {
+            start = 0;
+        }
 
-        vector<pair<string, dtl::elemInfo> > ses_v = d.getSes().getSequence();
-        for (vector<pair<string, dtl::elemInfo> >::iterator sit=ses_v.begin(); sit!=ses_v.end(); ++sit) {
-            switch (sit->second.type) {
-            case dtl::SES_ADD:
-                //cout << "ADD: \"" << sit->first << "\"" << endl;
-                additions += sit->first;
-                break;
-            case dtl::SES_DELETE:
-                //cout << "DEL: \"" << sit->first << "\"" << endl;
-                deletions += sit->first;
-                break;
+        // the tokens of the common suffix start at its first break
+        size_t last_end = last_text.size();
+        size_t end = text.size();
+        if (config.trim_suffix) {
+            size_t suffix = common_suffix(last_text.data() + last_text.size(),
+                                          text.data() + text.size(), common - prefix);
+            size_t first_break = last_text.find_first_of(TOKEN_BREAKS, last_text.size() - suffix);
+            if (first_break != string::npos) {
+                last_end = first_break + 1;
+                end = last_end - last_text.size() + text.size();
             }
         }
+
+        // tokens are diffed as ids, which stand for the same text in both
+        diffWorkspace *workspace = threadWorkspace<diffWorkspace>::get();
+        tokenTable& table = workspace->table;
+        token_table_clear(&table);
+        tokenChanges changes;
+        changes.table = &table;
+        changes.additions = &additions;
+        changes.deletions = &deletions;
+
+        // lines cannot start with the empty token which a break at 0 closes
+        bool empty_token = start == 0 && (starts_with_break(last_text) || starts_with_break(text));
+        if (config.line_diff && !empty_token) {
+            diff_lines(workspace, last_text, text, start, last_end, end, &changes, result);
+        } else {
+            vector<uint32_t>& last_tokens = workspace->last_tokens;
+            vector<uint32_t>& tokens = workspace->tokens;
+            last_tokens.clear();
+            tokens.clear();
+            tokenize(&table, last_text, start, last_end, &last_tokens);
+            tokenize(&table, text, start, end, &tokens);
+
+            // do the diff
+            diff_token_ids(last_tokens, tokens, &changes, result);
+        }
     }
     
     if (!additions.empty()) {
         //cout << "ADD: " << additions << endl;
-        for (vector<pcrecpp::RE>::iterator r = data->regexes.begin(); r != data->regexes.end(); ++r) {
+        for (vector<pcrecpp::RE>::iterator r = config.regexes.begin(); r != config.regexes.end(); ++r) {
             pcrecpp::RE& regex = *r;
             regex_matches_adds.push_back(regex.PartialMatch(additions));
         }
@@ -305,45 +715,394 @@ write_row(revisionData *data)
 
     if (!deletions.empty()) {
         //cout << "DEL: " << deletions << endl;
-        for (vector<pcrecpp::RE>::iterator r = data->regexes.begin(); r != data->regexes.end(); ++r) {
+        for (vector<pcrecpp::RE>::iterator r = config.regexes.begin(); r != config.regexes.end(); ++r) {
             pcrecpp::RE& regex = *r;
             regex_matches_dels.push_back(regex.PartialMatch(deletions));
         }
     }
+}
+
+/* Derives the byte frequencies of a revision's text for -E from those of the
+ * previous revision's tokens, minus those of the deleted tokens and plus
+ * those of the added ones, and the text after the last token break.  The
+ * text is counted in full instead for the first revision of an article, or
+ * if its diff is not in tokens or larger than the text.
+ */
+static void
+update_byte_freqs(articleData *article, revision *rev, revisionResult *result)
+{
+    string& text = rev->text;
+    size_t last_break = text.find_last_of(TOKEN_BREAKS);
+    size_t tokens_end = (last_break == string::npos) ? 0 : last_break;
+    int *freqs = article->token_freqs;
+
+    if (article->token_freqs_valid && result->token_diff
+            && result->additions.size() + result->deletions.size() < text.size()) {
+        const unsigned char *c = (const unsigned char *) result->deletions.data();
+        for (size_t i = 0; i < result->deletions.size(); ++i) {
+            --freqs[c[i]];
+        }
+        c = (const unsigned char *) result->additions.data();
+        for (size_t i = 0; i < result->additions.size(); ++i) {
+            ++freqs[c[i]];
+        }
+    } else {
+        disorder_ctx counts;
+        disorder_reset(&counts);
+        disorder_add(&counts, text.data(), tokens_end);
+        disorder_freqs(&counts, freqs);
+    }
+    article->token_freqs_valid = true;
+
+    memcpy(result->byte_freqs, freqs, sizeof(article->token_freqs));
+    const unsigned char *c = (const unsigned char *) text.data();
+    for (size_t i = tokens_end; i < text.size(); ++i) {
+        ++result->byte_freqs[c[i]];
+    }
+}
 
-    data->last_text_tokens = text_tokens;
+/* 
+ * write a line of comma-separated value formatted data to the output
+ * follows the form:
+ * title,articleid,revid,date,time,anon,editor,editorid,minor,comment
+ * (str)  (int)    (int) (str)(str)(bin)(str)   (int)   (bin) (str)
+ *
+ * it is called for each revision of a chunk, in order, by process_chunk(),
+ * after analyze_revision() and diff_revision()
+ */
+static void
+write_row(articleData *article, revision *rev, revisionResult *result, ostream& out)
+{
+    char *digest_hex = result->digest_hex;
+
+    uint64_t reverted_to; // id of previous revision
+    bool reverted = revert_record(&article->reverts, result->digest,
+                                  strtoull(rev->revid.c_str(), NULL, 10), &reverted_to);
 
+    string& text = rev->text;
+
+    if (config.incremental_entropy) {
+        update_byte_freqs(article, rev, result);
+    }
+    float entropy = shannon_H_freqs(result->byte_freqs, text.size());
 
     // print line of tsv output
-    cout
-        << data->title << "\t"
-        << data->articleid << "\t"
-        << data->revid << "\t"
-        << data->date << " "
-        << data->time << "\t"
-        << ((data->editor[0] != '\0') ? "FALSE" : "TRUE") << "\t"
-        << data->editor << "\t"
-        << data->editorid << "\t"
-        << ((data->minor) ? "TRUE" : "FALSE") << "\t"
-        << (unsigned int) data->text_size << "\t"
-        << shannon_H(data->text, data->text_size) << "\t"
-        << md5_hex_output << "\t"
-        << reverted_to << "\t"
-        << (int) additions.size() << "\t"
-        << (int) deletions.size();
-
-    for (int n = 0; n < data->regex_names.size(); ++n) {
-        cout << "\t" << ((!regex_matches_adds.empty() && regex_matches_adds.at(n)) ? "TRUE" : "FALSE")
-             << "\t" << ((!regex_matches_dels.empty() && regex_matches_dels.at(n)) ? "TRUE" : "FALSE");
+    out
+        << article->title << "\t"
+        << article->articleid << "\t"
+        << rev->revid << "\t"
+        << rev->date << " "
+        << rev->time << "\t"
+        << ((!rev->editor.empty()) ? "FALSE" : "TRUE") << "\t"
+        << rev->editor << "\t"
+        << rev->editorid << "\t"
+        << ((rev->minor) ? "TRUE" : "FALSE") << "\t"
+        << (unsigned int) text.size() << "\t"
+        << entropy << "\t"
+        << digest_hex << "\t";
+    if (reverted) {
+        out << reverted_to;
     }
-    cout << endl;
+    out << "\t"
+        << (int) result->additions.size() << "\t"
+        << (int) result->deletions.size();
+    if (config.diff_budget > 0) {
+        out << "\t" << (result->approximate ? "TRUE" : "FALSE");
+    }
+
+    vector<bool>& regex_matches_adds = result->regex_matches_adds;
+    vector<bool>& regex_matches_dels = result->regex_matches_dels;
+    for (int n = 0; n < config.regex_names.size(); ++n) {
+        out << "\t" << ((!regex_matches_adds.empty() && regex_matches_adds.at(n)) ? "TRUE" : "FALSE")
+            << "\t" << ((!regex_matches_dels.empty() && regex_matches_dels.at(n)) ? "TRUE" : "FALSE");
+    }
+    out << endl;
 
     // 
-    if (data->output_type == FULL) {
-        cout << "comment:" << data->comment << endl
-             << "text:" << endl << data->text << endl;
+    if (config.output_type == FULL) {
+        out << "comment:" << rev->comment << endl
+            << "text:" << endl << text << endl;
+    }
+
+}
+
+// a window of revisions being analyzed and diffed in parallel
+typedef struct {
+    articleData *article;
+    revision *revisions;
+    revisionResult *results;
+} revisionWindow;
+
+static void
+analyze_window_revision(void *vwindow, size_t i)
+{
+    revisionWindow *window = (revisionWindow*) vwindow;
+    analyze_revision(&window->revisions[i], &window->results[i]);
+}
+
+/* the text which revision i of a window is diffed against */
+static const string&
+window_last_text(revisionWindow *window, size_t i)
+{
+    return (i == 0) ? window->article->last_text : window->revisions[i - 1].text;
+}
+
+static void
+diff_window_revision(void *vwindow, size_t i)
+{
+    revisionWindow *window = (revisionWindow*) vwindow;
+    if (config.diff_cache_size > 0 && window->results[i].cached) {
+        return;
+    }
+    diff_revision(window_last_text(window, i), &window->revisions[i], &window->results[i]);
+}
+
+/* the size of the digests of texts, MD5 or with -s SHA-1 */
+static size_t
+digest_size(void)
+{
+    return config.dump_sha1 ? 20 : 16;
+}
+
+/* the digest of the text which revision i of a window is diffed against, or
+ * NULL for the first revision of an article
+ */
+static const unsigned char *
+last_digest(revisionWindow *window, size_t i)
+{
+    if (i > 0) {
+        return window->results[i - 1].digest;
+    }
+    return window->article->last_digest_valid ? window->article->last_digest : NULL;
+}
+
+/* sets a revision's diff to a cached one */
+static void
+use_diff(const cachedDiff& diff, bool reversed, revisionResult *result)
+{
+    result->additions = reversed ? diff.deletions : diff.additions;
+    result->deletions = reversed ? diff.additions : diff.deletions;
+    result->regex_matches_adds = reversed ? diff.regex_matches_dels : diff.regex_matches_adds;
+    result->regex_matches_dels = reversed ? diff.regex_matches_adds : diff.regex_matches_dels;
+    result->token_diff = diff.token_diff;
+    result->approximate = diff.approximate;
+}
+
+static void
+keep_diff(const revisionResult& result, cachedDiff *diff)
+{
+    diff->additions = result.additions;
+    diff->deletions = result.deletions;
+    diff->regex_matches_adds = result.regex_matches_adds;
+    diff->regex_matches_dels = result.regex_matches_dels;
+    diff->token_diff = result.token_diff;
+    diff->approximate = result.approximate;
+}
+
+/* With -C, finds the revisions of a window, once they are hashed, whose
+ * diffs will be in the article's cache when keep_diffs() looks them up:
+ * those in it now, and those diffing the same texts as an earlier revision
+ * of the window, either way round.  The rest are diffed.
+ */
+static void
+look_up_diffs(revisionWindow *window, size_t n)
+{
+    const diffCache *cache = &window->article->diffs;
+    size_t size = digest_size();
+    vector<bool> token_diffs(n);
+    for (size_t i = 0; i < n; ++i) {
+        revisionResult *result = &window->results[i];
+        result->cached = false;
+        const unsigned char *from = last_digest(window, i);
+        if (from == NULL) {
+            continue;
+        }
+        const unsigned char *to = result->digest;
+        token_diffs[i] = window_last_text(window, i).find_first_of(TOKEN_BREAKS) != string::npos;
+
+        result->cached = diff_cache_contains(cache, from, to, token_diffs[i]);
+        for (size_t j = 0; j < i && !result->cached; ++j) {
+            const unsigned char *earlier_from = last_digest(window, j);
+            const unsigned char *earlier_to = window->results[j].digest;
+            if (earlier_from == NULL) {
+                continue;
+            }
+            result->cached = (memcmp(earlier_from, from, size) == 0 && memcmp(earlier_to, to, size) == 0)
+                || (token_diffs[i] && token_diffs[j]
+                    && memcmp(earlier_from, to, size) == 0 && memcmp(earlier_to, from, size) == 0);
+        }
     }
+}
 
+/* With -C, looks up each revision of a window in the cache and keeps the
+ * diffs it lacks, in order, just as if the revisions came one at a time, so
+ * that the window size changes nothing.  A diff expected to be found which
+ * was evicted after all is taken now.
+ */
+static void
+keep_diffs(revisionWindow *window, size_t n)
+{
+    diffCache *cache = &window->article->diffs;
+    cachedDiff diff;
+    for (size_t i = 0; i < n; ++i) {
+        revisionResult *result = &window->results[i];
+        const unsigned char *from = last_digest(window, i);
+        if (from == NULL) {
+            continue;
+        }
+        const string& last_text = window_last_text(window, i);
+        bool token_diff = last_text.find_first_of(TOKEN_BREAKS) != string::npos;
+
+        bool reversed;
+        const cachedDiff *found = diff_cache_find(cache, from, result->digest, token_diff, &reversed);
+        if (found != NULL) {
+            use_diff(*found, reversed, result);
+            continue;
+        }
+        if (result->cached) {
+            diff_revision(last_text, &window->revisions[i], result);
+        }
+        keep_diff(*result, &diff);
+        diff_cache_add(cache, from, result->digest, diff);
+    }
+}
+
+/* renders a chunk of revisions into out, in order; runs on a worker thread
+ * when a pipeline is in use.  Frees the chunk, and the article with its last
+ * chunk.
+ *
+ * The chunk is processed in windows of config.window revisions.  Within a
+ * window every revision is hashed, then tokenized and diffed against its
+ * predecessor, on up to config.threads threads; only the rows themselves,
+ * which carry the revert detection state, are written serially.
+ */
+static void
+process_chunk(void *vchunk, string *out)
+{
+    revisionChunk *chunk = (revisionChunk*) vchunk;
+    articleData *article = chunk->article;
+    ostringstream rows;
+
+    // pages filtered out by -t, -N or -P never get this far, see end()
+    if (!chunk->revisions.empty()) {
+        size_t window_size = config.window > 1 ? config.window : 1;
+        vector<revisionResult> results(min(window_size, chunk->revisions.size()));
+        revisionWindow window;
+        window.article = article;
+        window.results = &results[0];
+
+        for (size_t first = 0; first < chunk->revisions.size(); first += window_size) {
+            size_t n = min(window_size, chunk->revisions.size() - first);
+            window.revisions = &chunk->revisions[first];
+
+            // small windows are not worth waking the helpers and handing them
+            // the revisions
+            int threads = 1;
+            if (n > 1) {
+                size_t text_size = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    text_size += window.revisions[i].text.size();
+                }
+                if (text_size >= WINDOW_THREADING_TEXT_SIZE) {
+                    threads = config.threads;
+                }
+            }
+
+            parallel_for(n, threads, analyze_window_revision, &window);
+            if (config.diff_cache_size > 0) {
+                look_up_diffs(&window, n);
+            }
+            parallel_for(n, threads, diff_window_revision, &window);
+            if (config.diff_cache_size > 0) {
+                keep_diffs(&window, n);
+            }
+
+            for (size_t i = 0; i < n; ++i) {
+                write_row(article, &window.revisions[i], &results[i], rows);
+            }
+            // the rows are written, so the text is no longer needed
+            article->last_text.swap(window.revisions[n - 1].text);
+            memcpy(article->last_digest, results[n - 1].digest, sizeof(article->last_digest));
+            article->last_digest_valid = true;
+        }
+    }
+    *out = rows.str();
+
+    if (chunk->last) {
+        revert_free(&article->reverts);
+        diff_cache_free(&article->diffs);
+        delete article;
+    }
+    delete chunk;
+}
+
+/* hands the pending chunk to the pipeline, or processes it right away */
+static void
+flush_chunk(revisionData *data, bool last)
+{
+    revisionChunk *chunk = data->chunk;
+
+    if (chunk == NULL) {
+        if (!last || data->article == NULL) {
+            return;
+        }
+        // earlier chunks of the article may still be queued, so its state is
+        // released by an empty final chunk rather than here
+        chunk = new revisionChunk;
+        chunk->article = data->article;
+        chunk->text_size = 0;
+    }
+    data->chunk = NULL;
+    chunk->last = last;
+
+    if (data->pipe != NULL) {
+        pipeline_submit(data->pipe, chunk, chunk->article, chunk->text_size + 1);
+    } else {
+        string rows;
+        process_chunk(chunk, &rows);
+        fwrite(rows.data(), 1, rows.size(), data->out);
+    }
+}
+
+/* copies the completed revision out of the parse buffers into the pending
+ * chunk of its article
+ */
+static void
+queue_revision(revisionData *data)
+{
+    if (data->article == NULL) {
+        data->article = new articleData;
+        data->article->title = data->title;
+        data->article->articleid = data->articleid;
+        revert_init(&data->article->reverts, config.revert_radius);
+        data->article->token_freqs_valid = false;
+        diff_cache_init(&data->article->diffs, digest_size(), config.diff_cache_size);
+        data->article->last_digest_valid = false;
+    }
+    if (data->chunk == NULL) {
+        data->chunk = new revisionChunk;
+        data->chunk->article = data->article;
+        data->chunk->text_size = 0;
+        data->chunk->last = false;
+    }
+
+    revisionChunk *chunk = data->chunk;
+    chunk->revisions.push_back(revision());
+    revision& rev = chunk->revisions.back();
+    rev.revid = data->revid;
+    rev.date = data->date;
+    rev.time = data->time;
+    rev.editor = data->editor;
+    rev.editorid = data->editorid;
+    rev.comment = data->comment;
+    rev.text.assign(data->text, data->text_size);
+    rev.sha1.assign(data->sha1, data->sha1_size);
+    rev.minor = data->minor;
+    chunk->text_size += data->text_size;
+
+    if (chunk->text_size >= CHUNK_TEXT_SIZE) {
+        flush_chunk(data, false);
+    }
 }
 
 void
@@ -351,8 +1110,10 @@ split_timestamp(revisionData *data)
 {
     char *t = data->timestamp;
     strncpy(data->date, data->timestamp, DATE_LENGTH);
+    data->date[DATE_LENGTH] = '\0';
     char *timeinstamp = &data->timestamp[DATE_LENGTH+1];
     strncpy(data->time, timeinstamp, TIME_LENGTH);
+    data->time[TIME_LENGTH] = '\0';
 }
 
 // like strncat but with previously known length
@@ -368,6 +1129,19 @@ strlcatn(char *dest, const char *src, size_t dest_len, size_t n)
    return dest;
 }
 
+/* whether a page title matches one of the -t regexes, if any were given */
+static bool
+title_wanted(const char *title)
+{
+    if (config.wp_namespace_res.empty())
+        return true;
+    for (vector<pcrecpp::RE>::iterator r = config.wp_namespace_res.begin(); r != config.wp_namespace_res.end(); ++r) {
+        if (r->PartialMatch(title))
+            return true;
+    }
+    return false;
+}
+
 static void
 charhndl(void* vdata, const XML_Char* s, int len)
 { 
@@ -378,9 +1152,9 @@ charhndl(void* vdata, const XML_Char* s, int len)
             case TEXT:
                     // check if we'd overflow our buffer
                     bufsz = data->text_size + len;
-                    if (bufsz + 1 > text_buffer_size) {
-                        data->text = (char*) realloc(data->text, bufsz + 1);
-                        text_buffer_size = bufsz + 1;
+                    if (bufsz + 1 > data->text_capacity) {
+                        data->text_capacity = max(bufsz + 1, 2 * data->text_capacity);
+                        data->text = (char*) realloc(data->text, data->text_capacity);
                     }
                     strlcatn(data->text, s, data->text_size, len);
                     data->text_size = bufsz;
@@ -393,6 +1167,14 @@ charhndl(void* vdata, const XML_Char* s, int len)
                     strlcatn(data->title, s, data->title_size, len);
                     data->title_size += len;
                     break;
+            case SHA1:
+                    strlcatn(data->sha1, s, data->sha1_size, len);
+                    data->sha1_size += len;
+                    break;
+            case NAMESPACE:
+                    strlcatn(data->ns, s, data->ns_size, len);
+                    data->ns_size += len;
+                    break;
             case ARTICLEID:
                    // printf("articleid = %s\n", t);
                     strlcatn(data->articleid, s, data->articleid_size, len);
@@ -429,60 +1211,92 @@ charhndl(void* vdata, const XML_Char* s, int len)
     }
 }
 
+static void
+set_character_handler(revisionData *data, XML_CharacterDataHandler handler)
+{
+    if (data->scan != NULL) {
+        scanner_set_character_handler(data->scan, handler);
+    } else {
+        XML_SetCharacterDataHandler(data->parser, handler);
+    }
+}
+
 static void
 start(void* vdata, const XML_Char* name, const XML_Char** attr)
 {
     revisionData* data = (revisionData*) vdata;
+    enum schematag tag = schema_lookup(name);
     
-    if (strcmp(name,"title") == 0) {
+    if (tag == TAG_TITLE) {
+        if (data->position == SKIP) {
+            set_character_handler(data, charhndl);
+        }
         cleanup_article(data); // cleans up data from last article
         data->element = TITLE;
         data->position = TITLE_BLOCK;
     } else if (data->position != SKIP) {
-        if (strcmp(name,"revision") == 0) {
-            data->element = REVISION;
-            data->position = REVISION_BLOCK;
-        } else if (strcmp(name, "contributor") == 0) {
-            data->element = CONTRIBUTOR;
-            data->position = CONTRIBUTOR_BLOCK;
-        } else if (strcmp(name,"id") == 0)
-            switch (data->position) {
-                case TITLE_BLOCK:
-                    data->element = ARTICLEID;
-                    break;
-                case REVISION_BLOCK: 
-                    data->element = REVID;
-                    break;
-                case CONTRIBUTOR_BLOCK:
-                    data->element = EDITORID;
-                    break;
-            }
-    
-        // minor tag has no character data, so we parse here
-        else if (strcmp(name,"minor") == 0) {
-            data->element = MINOR;
-            data->minor = true; 
+        switch (tag) {
+            case TAG_REVISION:
+                data->element = REVISION;
+                data->position = REVISION_BLOCK;
+                break;
+            case TAG_CONTRIBUTOR:
+                data->element = CONTRIBUTOR;
+                data->position = CONTRIBUTOR_BLOCK;
+                break;
+            case TAG_ID:
+                switch (data->position) {
+                    case TITLE_BLOCK:
+                        data->element = ARTICLEID;
+                        break;
+                    case REVISION_BLOCK: 
+                        data->element = REVID;
+                        break;
+                    case CONTRIBUTOR_BLOCK:
+                        data->element = EDITORID;
+                        break;
+                    default:
+                        break;
+                }
+                break;
+            // minor tag has no character data, so we parse here
+            case TAG_MINOR:
+                data->element = MINOR;
+                data->minor = true; 
+                break;
+            case TAG_TIMESTAMP:
+                data->element = TIMESTAMP;
+                break;
+            case TAG_NS:
+                data->element = NAMESPACE;
+                break;
+            case TAG_USERNAME:
+                data->element = EDITOR;
+                break;
+            case TAG_IP:
+                data->element = EDITORID;
+                break;
+            case TAG_COMMENT:
+                data->element = COMMENT;
+                break;
+            case TAG_TEXT:
+                data->element = TEXT;
+                break;
+            case TAG_SHA1:
+                if (config.dump_sha1) {
+                    data->element = SHA1;
+                }
+                break;
+            case TAG_PAGE:
+            case TAG_MEDIAWIKI:
+            case TAG_RESTRICTIONS:
+            case TAG_SITEINFO:
+                data->element = UNUSED;
+                break;
+            // the rest is recognized but not collected
+            default:
+                break;
         }
-        else if (strcmp(name,"timestamp") == 0)
-            data->element = TIMESTAMP;
-
-        else if (strcmp(name, "username") == 0)
-            data->element = EDITOR;
-
-        else if (strcmp(name,"ip") == 0) 
-            data->element = EDITORID;
-
-        else if (strcmp(name,"comment") == 0)
-            data->element = COMMENT;
-
-        else if (strcmp(name,"text") == 0)
-            data->element = TEXT;
-
-        else if (strcmp(name,"page") == 0 
-                || strcmp(name,"mediawiki") == 0
-                || strcmp(name,"restrictions") == 0
-                || strcmp(name,"siteinfo") == 0)
-            data->element = UNUSED;
     }
 
 }
@@ -492,29 +1306,340 @@ static void
 end(void* vdata, const XML_Char* name)
 {
     revisionData* data = (revisionData*) vdata;
-    if (strcmp(name, "revision") == 0 && data->position != SKIP) {
-        write_row(data); // crucial... :)
+    if ((data->element == TITLE && !title_wanted(data->title))
+            || (data->element == NAMESPACE && !config.namespaces.empty()
+                && config.namespaces.find(strtol(data->ns, NULL, 10)) == config.namespaces.end())
+            || (data->element == ARTICLEID && !config.page_ids.empty()
+                && config.page_ids.find(strtoul(data->articleid, NULL, 10)) == config.page_ids.end())) {
+        // the page is filtered out, so the rest of it is parsed without
+        // collecting anything until the next title
+        data->position = SKIP;
+        data->element = UNUSED;
+        set_character_handler(data, NULL);
+        return;
+    }
+
+    enum schematag tag = schema_lookup(name);
+    if (tag == TAG_REVISION && data->position != SKIP) {
+        queue_revision(data); // crucial... :)
         cleanup_revision(data);  // also crucial
+    } else if (tag == TAG_PAGE) {
+        flush_chunk(data, true);
+        data->article = NULL;
+        data->element = UNUSED;
     } else {
         data->element = UNUSED; // sets our state to "not-in-useful"
     }                           // thus avoiding unpleasant character data 
                                 // b/w tags (newlines etc.)
 }
 
+/* creates an expat parser which fills in data through our callbacks */
+static XML_Parser
+create_parser(revisionData *data)
+{
+    // create a new instance of the expat parser
+    XML_Parser parser = XML_ParserCreate("UTF-8");
+
+    // makes the parser pass "data" as the first argument to every callback 
+    XML_SetUserData(parser, data);
+    data->parser = parser;
+    void (*startFnPtr)(void*, const XML_Char*, const XML_Char**) = start;
+    void (*endFnPtr)(void*, const XML_Char*) = end;
+    void (*charHandlerFnPtr)(void*, const XML_Char*, int) = charhndl;
+
+    // sets start and end to be the element start and end handlers
+    XML_SetElementHandler(parser, startFnPtr, endFnPtr);
+    // sets charhndl to be the callback for character data
+    XML_SetCharacterDataHandler(parser, charHandlerFnPtr);
+
+    return parser;
+}
+
+// a byte range of a memory-mapped dump, parsed independently on its own thread
+typedef struct {
+    const char *base;  // start of the mapping, for error offsets
+    const char *begin;
+    const char *end;
+    bool first;        // contains the real start of the document
+    bool last;         // contains the real end of the document
+    FILE *out;
+    int status;
+} inputShard;
+
+static void *
+parse_shard(void *vshard)
+{
+    inputShard *shard = (inputShard*) vshard;
+
+    // every shard but the first starts at a <page>, and every shard but the
+    // last stops right before one, so each is wrapped in a stand-in root
+    static const char open_root[] = "<mediawiki>";
+    static const char close_root[] = "</mediawiki>";
+    size_t prefix = shard->first ? 0 : strlen(open_root);
+
+    revisionData data;
+    init_data(&data, NULL, shard->out);
+    XML_Parser parser = create_parser(&data);
+
+    bool ok = true;
+    if (!shard->first) {
+        ok = XML_Parse(parser, open_root, strlen(open_root), 0) != XML_STATUS_ERROR;
+    }
+    for (const char *p = shard->begin; ok && p < shard->end; p += SHARD_PARSE_SIZE) {
+        size_t len = min((size_t) (shard->end - p), (size_t) SHARD_PARSE_SIZE);
+        ok = XML_Parse(parser, p, len, 0) != XML_STATUS_ERROR;
+    }
+    if (ok) {
+        if (shard->last) {
+            ok = XML_Parse(parser, "", 0, 1) != XML_STATUS_ERROR;
+        } else {
+            ok = XML_Parse(parser, close_root, strlen(close_root), 1) != XML_STATUS_ERROR;
+        }
+    }
+
+    if (!ok) {
+        long long offset = (shard->begin - shard->base) + XML_GetCurrentByteIndex(parser) - prefix;
+        cerr << "XML ERROR: " << XML_ErrorString(XML_GetErrorCode(parser)) << " at byte offset "
+             << offset << endl;
+        shard->status = 1;
+    }
+
+    // emit whatever was completed before an error
+    flush_chunk(&data, true);
+    XML_ParserFree(parser);
+    free_data(&data, 1);
+
+    return NULL;
+}
+
+/* Maps the dump at path and splits it into byte ranges which start at <page>
+ * tags, each parsed by its own expat parser on its own thread.  The first
+ * range writes straight to stdout and the others to temporary files, which
+ * are appended in order once every range is done.
+ */
+static int
+parse_sharded(const char *path, int shards)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        cerr << "could not open " << path << endl;
+        return 1;
+    }
+    size_t size = st.st_size;
+    const char *base = NULL;
+
+    char head[6];
+    ssize_t head_len = pread(fd, head, sizeof(head), 0);
+    if (head_len > 0 && input_format(head, head_len) != INPUT_PLAIN) {
+        cerr << "sharded parsing (-m) needs an uncompressed dump" << endl;
+        close(fd);
+        return 1;
+    }
+
+    if (size > 0) {
+        base = (const char*) mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base == MAP_FAILED) {
+            cerr << "could not map " << path << endl;
+            close(fd);
+            return 1;
+        }
+        madvise((void*) base, size, MADV_SEQUENTIAL);
+    }
+
+    // snap each boundary forward to the next page start
+    static const char page_tag[] = "<page>";
+    vector<const char*> bounds;
+    bounds.push_back(base);
+    for (int k = 1; k < shards; ++k) {
+        const char *target = base + size / shards * k;
+        if (target <= bounds.back()) {
+            continue;
+        }
+        const char *page = (const char*) memmem(target, base + size - target,
+                                                page_tag, strlen(page_tag));
+        if (page == NULL) {
+            break;
+        }
+        if (page > bounds.back()) {
+            bounds.push_back(page);
+        }
+    }
+    bounds.push_back(base + size);
+
+    size_t n = bounds.size() - 1;
+    vector<inputShard> ranges(n);
+    vector<pthread_t> threads(n);
+    for (size_t k = 0; k < n; ++k) {
+        inputShard& shard = ranges[k];
+        shard.base = base;
+        shard.begin = bounds[k];
+        shard.end = bounds[k + 1];
+        shard.first = k == 0;
+        shard.last = k == n - 1;
+        shard.out = (k == 0) ? stdout : tmpfile();
+        shard.status = 0;
+        if (shard.out == NULL) {
+            cerr << "could not create a temporary file for shard " << k << endl;
+            exit(1);
+        }
+        pthread_create(&threads[k], NULL, parse_shard, &shard);
+    }
+
+    int status = 0;
+    vector<char> buf(MEGABYTE);
+    for (size_t k = 0; k < n; ++k) {
+        pthread_join(threads[k], NULL);
+        status |= ranges[k].status;
+    }
+    for (size_t k = 1; k < n; ++k) {
+        rewind(ranges[k].out);
+        size_t len;
+        while ((len = fread(&buf[0], 1, buf.size(), ranges[k].out)) > 0) {
+            fwrite(&buf[0], 1, len, stdout);
+        }
+        fclose(ranges[k].out);
+    }
+    fflush(stdout);
+
+    if (size > 0) {
+        munmap((void*) base, size);
+    }
+    close(fd);
+
+    return status;
+}
+
+/* whether a page of the multistream index passes the -P and -t filters */
+static bool
+page_wanted(unsigned long pageid, const string& title)
+{
+    if (!config.page_ids.empty() && config.page_ids.find(pageid) == config.page_ids.end())
+        return false;
+    return title_wanted(title.c_str());
+}
+
+/* adds the page ids in a comma separated list, or in the file named by
+ * @path with one or more per line, to config.page_ids
+ */
+static void
+read_page_ids(const char *arg)
+{
+    string ids;
+    if (arg[0] == '@') {
+        FILE *f = fopen(arg + 1, "r");
+        if (f == NULL) {
+            cerr << "could not open the page id list " << arg + 1 << endl;
+            exit(1);
+        }
+        char buf[BUFSIZ];
+        size_t len;
+        while ((len = fread(buf, 1, sizeof(buf), f)) > 0)
+            ids.append(buf, len);
+        fclose(f);
+    } else {
+        ids = arg;
+    }
+
+    const char *p = ids.c_str();
+    while (*p != '\0') {
+        char *end;
+        unsigned long id = strtoul(p, &end, 10);
+        if (end == p) {
+            if (!isspace(*p) && *p != ',') {
+                cerr << "invalid page id list (-P): " << arg << endl;
+                exit(1);
+            }
+            ++p;
+        } else {
+            config.page_ids.insert(id);
+            p = end;
+        }
+    }
+}
+
+/* adds the comma separated namespace numbers to config.namespaces */
+static void
+read_namespaces(const char *arg)
+{
+    const char *p = arg;
+    for (;;) {
+        char *end;
+        long ns = strtol(p, &end, 10);
+        if (end == p || (*end != ',' && *end != '\0')) {
+            cerr << "invalid namespace list (-N): " << arg << endl;
+            exit(1);
+        }
+        config.namespaces.insert(ns);
+        if (*end == '\0')
+            break;
+        p = end + 1;
+    }
+}
+
+/* with -C, how often the diff caches spared a diff */
+static void
+report_diff_cache(void)
+{
+    if (config.diff_cache_size == 0) {
+        return;
+    }
+    unsigned long long hits, misses;
+    diff_cache_totals(&hits, &misses);
+    cerr << "diff cache: " << hits << " hits, " << misses << " misses" << endl;
+}
+
 void print_usage(char* argv[]) {
     cerr << "usage: <wikimedia dump xml> | " << argv[0] << "[options]" << endl
+         << "       " << argv[0] << " [options] <wikimedia dump xml>" << endl
          << endl
          << "options:" << endl
          << "  -v   verbose mode prints text and comments after each line of tab separated data" << endl
          << "  -n   name of the following regex (e.g. -n name -r \"...\")" << endl
          << "  -r   regex to check against additions and deletions" << endl
          << "  -t   regex(es) to check title against as a way of limiting output to specific namespaces" << endl
+         << "  -N   only process pages in these namespaces (comma separated numbers, e.g. 0,1)" << endl
+         << "  -j   number of worker threads processing pages (default 1, i.e. no threads)" << endl
+         << "  -w   diff windows of this many revisions of a page concurrently, using -j threads" << endl
+         << "  -b   read the dump this many megabytes at a time (default 4)" << endl
+         << "  -s   detect reverts by the SHA-1 digests given in the dump rather than by MD5s" << endl
+         << "       of the text, and report them in place of the MD5 (as text_sha1)" << endl
+         << "  -R   only detect reverts to one of this many preceding revisions (default 0," << endl
+         << "       meaning any earlier revision of the page)" << endl
+         << "  -T   also leave the tokens which a revision ends with in common with the one" << endl
+         << "       before it out of its diff (faster for edits near the start of long pages," << endl
+         << "       but of several equally short diffs a different one may be reported)" << endl
+         << "  -D   diff by anchoring on rare tokens (histogram diff) rather than finding" << endl
+         << "       a shortest diff (near-linear time on large rewrites and blankings, but" << endl
+         << "       the additions and deletions are sometimes larger)" << endl
+         << "  -L   diff revisions with more than this many tokens between them in memory" << endl
+         << "       linear in their size, rather than quadratic in the size of the change" << endl
+         << "  -B   give up diffs which need more than this many token differences, and" << endl
+         << "       count the tokens whose number changed as added or deleted instead; such" << endl
+         << "       rows are marked TRUE in an extra diff_approx column" << endl
+         << "  -H   diff the lines of revisions first, then only the tokens of changed lines" << endl
+         << "       (much faster on long pages; the same diff where the changed lines line up)" << endl
+         << "  -C   keep up to this many megabytes of diffs per page, so that a pair of texts" << endl
+         << "       diffed before either way round, as by reverts, is not diffed again (but a" << endl
+         << "       pair found the other way round may report a different, equally short" << endl
+         << "       diff); the cache's hits and misses are reported on standard error at exit" << endl
+         << "  -E   update each revision's byte frequencies from its diff rather than counting" << endl
+         << "       its whole text for the entropy (same output, less work on long pages)" << endl
+         << "  -S   parse with the built-in MediaWiki scanner rather than expat (faster, but" << endl
+         << "       rejects XML beyond what MediaWiki exports contain)" << endl
+         << "  -m   map the dump file and parse this many page-aligned shards of it in parallel" << endl
+         << "  -P   only process the pages with these ids (comma separated, or @file of ids)" << endl
+         << "  -I   multistream index of the bzip2 dump file, used to decode only the streams" << endl
+         << "       holding pages selected by -P and -t" << endl
          << endl
          << "Takes a wikimedia data dump XML stream on standard in, and produces" << endl
          << "a tab-separated stream of revisions on standard out:" << endl
+         << "(bzip2, gzip and xz compressed dumps are decompressed on the fly, bzip2" << endl
+         << "multistream and xz dumps on up to -j threads)" << endl
          << endl
          << "title, articleid, revid, timestamp, anon, editor, editorid, minor," << endl
-         << "text_length, text_entropy, text_md5, reversion, additions_size, deletions_size" << endl
+         << "text_length, text_entropy, text_md5 (text_sha1 with -s), reversion, additions_size," << endl
+         << "deletions_size, diff_approx (with -B)" << endl
          << ".... and additional fields for each regex executed against add/delete diffs" << endl
          << endl
          << "Boolean fields are TRUE/FALSE except in the case of reversion, which is blank" << endl
@@ -533,13 +1658,28 @@ main(int argc, char *argv[])
     int dry_run = 0;
     // in "simple" output, we don't print text and comments
     output_type = SIMPLE;
+    config.threads = 1;
+    config.window = 0;
+    int shards = 1;
+    const char *index_path = NULL;
+    size_t read_size = READ_SIZE;
+    bool use_scanner = false;
+    config.dump_sha1 = false;
+    config.revert_radius = 0;
+    config.incremental_entropy = false;
+    config.trim_suffix = false;
+    config.diff_engine = DIFF_ONP;
+    config.linear_tokens = 0;
+    config.diff_budget = 0;
+    config.line_diff = false;
+    config.diff_cache_size = 0;
     char c;
     string regex_name;
 
     // the user data struct which is passed to callback functions
     revisionData data;
 
-    while ((c = getopt(argc, argv, "hvn:r:t:")) != -1)
+    while ((c = getopt(argc, argv, "hvn:r:t:j:w:m:P:I:N:b:SsR:ETDL:B:HC:")) != -1)
         switch (c)
         {
             case 'd':
@@ -552,8 +1692,8 @@ main(int argc, char *argv[])
                 regex_name = optarg;
                 break;
             case 'r':
-                data.regexes.push_back(pcrecpp::RE(optarg, pcrecpp::UTF8()));
-                data.regex_names.push_back(regex_name);
+                config.regexes.push_back(pcrecpp::RE(optarg, pcrecpp::UTF8()));
+                config.regex_names.push_back(regex_name);
                 if (!regex_name.empty()) {
                     regex_name.clear();
                 }
@@ -563,35 +1703,147 @@ main(int argc, char *argv[])
                 exit(0);
                 break;
             case 't':
-                data.wp_namespace_res.push_back(pcrecpp::RE(optarg, pcrecpp::UTF8()));
+                config.wp_namespace_res.push_back(pcrecpp::RE(optarg, pcrecpp::UTF8()));
+                break;
+            case 'j':
+                config.threads = atoi(optarg);
+                if (config.threads < 1) {
+                    cerr << "the number of threads (-j) must be at least 1" << endl;
+                    exit(1);
+                }
+                break;
+            case 'w':
+                config.window = atoi(optarg);
+                break;
+            case 'm':
+                shards = atoi(optarg);
+                break;
+            case 'P':
+                read_page_ids(optarg);
+                break;
+            case 'I':
+                index_path = optarg;
+                break;
+            case 'N':
+                read_namespaces(optarg);
+                break;
+            case 'b':
+                if (atoi(optarg) < 1) {
+                    cerr << "the read size (-b) must be at least 1 MB" << endl;
+                    exit(1);
+                }
+                read_size = (size_t) atoi(optarg) * MEGABYTE;
+                break;
+            case 'S':
+                use_scanner = true;
+                break;
+            case 's':
+                config.dump_sha1 = true;
+                break;
+            case 'E':
+                config.incremental_entropy = true;
+                break;
+            case 'T':
+                config.trim_suffix = true;
+                break;
+            case 'D':
+                config.diff_engine = DIFF_HISTOGRAM;
+                break;
+            case 'L':
+                if (atoi(optarg) < 1) {
+                    cerr << "the token count for linear space diffs (-L) must be at least 1" << endl;
+                    exit(1);
+                }
+                config.linear_tokens = atoi(optarg);
+                break;
+            case 'H':
+                config.line_diff = true;
+                break;
+            case 'C':
+                if (atoi(optarg) < 1) {
+                    cerr << "the diff cache size (-C) must be at least 1 MB" << endl;
+                    exit(1);
+                }
+                config.diff_cache_size = (size_t) atoi(optarg) * MEGABYTE;
+                break;
+            case 'B':
+                if (atoi(optarg) < 1) {
+                    cerr << "the diff budget (-B) must be at least 1" << endl;
+                    exit(1);
+                }
+                config.diff_budget = atoi(optarg);
+                break;
+            case 'R':
+                if (atoi(optarg) < 0) {
+                    cerr << "the revert radius (-R) cannot be negative" << endl;
+                    exit(1);
+                }
+                config.revert_radius = atoi(optarg);
                 break;
         }
+    config.output_type = output_type;
 
     if (dry_run) { // lets us print initialization options
         printf("simple_output = %i\n", output_type);
         exit(1);
     }
 
-    // create a new instance of the expat parser
-    XML_Parser parser = XML_ParserCreate("UTF-8");
+    // the dump is read from standard in unless a file is named
+    const char *input_path = (optind < argc) ? argv[optind] : NULL;
+    FILE *input = stdin;
+    if (shards > 1 && input_path == NULL) {
+        cerr << "sharded parsing (-m) needs the dump as a file argument" << endl;
+        exit(1);
+    }
+    if (use_scanner && shards > 1) {
+        cerr << "the scanner (-S) cannot be combined with sharded parsing (-m)" << endl;
+        exit(1);
+    }
+    if (index_path != NULL && (input_path == NULL || shards > 1)) {
+        cerr << "a multistream index (-I) needs the dump as a file argument, without -m" << endl;
+        exit(1);
+    }
+    if (input_path != NULL && shards <= 1) {
+        input = fopen(input_path, "rb");
+        if (input == NULL) {
+            cerr << "could not open " << input_path << endl;
+            exit(1);
+        }
+    }
 
-    // initialize the elements of the struct to default values
-    init_data(&data, output_type);
+    // with more than one thread, pages are processed by a worker pool while
+    // this thread parses, and written in their original order
+    pipeline *pipe = NULL;
+    if (config.threads > 1 && shards <= 1) {
+        pipe = pipeline_create(config.threads, process_chunk, pipeline_write_file, stdout,
+                               config.threads * INFLIGHT_TEXT_PER_THREAD);
+    }
 
+    schema_init();
 
-    // makes the parser pass "data" as the first argument to every callback 
-    XML_SetUserData(parser, &data);
-    void (*startFnPtr)(void*, const XML_Char*, const XML_Char**) = start;
-    void (*endFnPtr)(void*, const XML_Char*) = end;
-    void (*charHandlerFnPtr)(void*, const XML_Char*, int) = charhndl;
+    // initialize the elements of the struct to default values
+    init_data(&data, pipe, stdout);
 
-    // sets start and end to be the element start and end handlers
-    XML_SetElementHandler(parser, startFnPtr, endFnPtr);
-    // sets charhndl to be the callback for character data
-    XML_SetCharacterDataHandler(parser, charHandlerFnPtr);
+    XML_Parser parser = create_parser(&data);
+    if (use_scanner) {
+        data.scan = scanner_create(&data, start, end, charhndl);
+    }
+
+    inputStream *in = NULL;
+    if (index_path != NULL) {
+        vector<inputRange> ranges;
+        if (!multistream_ranges(index_path, input, page_wanted, &ranges)) {
+            exit(1);
+        }
+        in = input_open_ranges(input, ranges, config.threads);
+    } else if (shards <= 1) {
+        in = input_open(input, config.threads);
+        if (in == NULL) {
+            exit(1);
+        }
+    }
 
     bool done;
-    char buf[BUFSIZ];
 
     // write header
 
@@ -606,43 +1858,89 @@ main(int argc, char *argv[])
         << "minor" << "\t"
         << "text_size" << "\t"
         << "text_entropy" << "\t"
-        << "text_md5" << "\t"
+        << (config.dump_sha1 ? "text_sha1" : "text_md5") << "\t"
         << "reversion" << "\t"
         << "additions_size" << "\t"
         << "deletions_size";
+    if (config.diff_budget > 0) {
+        cout << "\t" << "diff_approx";
+    }
 
     int n = 0;
-    if (!data.regexes.empty()) {
-        for (vector<pcrecpp::RE>::iterator r = data.regexes.begin(); r != data.regexes.end(); ++r, ++n) {
-            if (data.regex_names.at(n).empty()) {
+    if (!config.regexes.empty()) {
+        for (vector<pcrecpp::RE>::iterator r = config.regexes.begin(); r != config.regexes.end(); ++r, ++n) {
+            if (config.regex_names.at(n).empty()) {
                 cout << "\t" << "regex_" << n << "_add"
                      << "\t" << "regex_" << n << "_del";
             } else {
-                cout << "\t" << data.regex_names.at(n) << "_add"
-                     << "\t" << data.regex_names.at(n) << "_del";
+                cout << "\t" << config.regex_names.at(n) << "_add"
+                     << "\t" << config.regex_names.at(n) << "_del";
             }
         }
     }
     cout << endl;
-    
-    // shovel data into the parser
-    do {
+
+    if (shards > 1) {
+        XML_ParserFree(parser);
+        int status = parse_sharded(input_path, shards);
+        report_diff_cache();
+        return status;
+    }
+
+    int status = 0;
+
+    if (data.scan != NULL) {
+        // the scanner hands out text as pointers into this buffer
+        vector<char> buf(read_size);
+        do {
+            size_t len = input_read(in, &buf[0], read_size);
+            done = len < read_size;
+            if (!scanner_parse(data.scan, &buf[0], len, done)) {
+                cerr << "XML ERROR: " << scanner_error(data.scan) << " at byte offset "
+                     << scanner_error_offset(data.scan) << " (parse without -S to use expat)" << endl;
+                status = 1;
+                break;
+            }
+        } while (!done);
+    } else {
+        // shovel data into the parser
+        do {
         
-        // read into buf a bufferfull of data from standard input
-        size_t len = fread(buf, 1, BUFSIZ, stdin);
-        done = len < BUFSIZ; // checks if we've got the last bufferfull
+            // read a bufferfull of data from the input directly into the
+            // parser's own buffer, saving a copy
+            void *buf = XML_GetBuffer(parser, read_size);
+            if (buf == NULL) {
+                cerr << "could not allocate a " << read_size << " byte parse buffer" << endl;
+                status = 1;
+                break;
+            }
+            size_t len = input_read(in, (char*) buf, read_size);
+            done = len < read_size; // checks if we've got the last bufferfull
         
-        // passes the buffer of data to the parser and checks for error
-        //   (this is where the callbacks are invoked)
-        if (XML_Parse(parser, buf, len, done) == XML_STATUS_ERROR) {
-            cerr << "XML ERROR: " << XML_ErrorString(XML_GetErrorCode(parser)) << " at line "
-                 << (int) XML_GetCurrentLineNumber(parser) << endl;
-            return 1;
-        }
-    } while (!done);
-   
+            // passes the buffer of data to the parser and checks for error
+            //   (this is where the callbacks are invoked)
+            if (XML_ParseBuffer(parser, len, done) == XML_STATUS_ERROR) {
+                cerr << "XML ERROR: " << XML_ErrorString(XML_GetErrorCode(parser)) << " at line "
+                     << (int) XML_GetCurrentLineNumber(parser) << endl;
+                status = 1;
+                break;
+            }
+        } while (!done);
+    }
 
+    // emit whatever was completed before an error or a truncated page
+    flush_chunk(&data, true);
+    if (pipe != NULL) {
+        pipeline_finish(pipe);
+    }
+    fflush(stdout);
+   
+    input_close(in);
     XML_ParserFree(parser);
+    if (data.scan != NULL) {
+        scanner_free(data.scan);
+    }
+    report_diff_cache();
 
-    return 0;
+    return status;
 }
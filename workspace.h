@@ -0,0 +1,46 @@
+/*
+ * The buffers which the work done on a thread keeps from one call to the
+ * next, so that they settle on the size of the largest: one workspace of
+ * each type per thread, created on first use and freed when the thread
+ * exits.
+ */
+
+#ifndef __WORKSPACE_H_
+#define __WORKSPACE_H_
+
+#include <pthread.h>
+
+template <typename T>
+class threadWorkspace {
+public:
+    /* the calling thread's workspace */
+    static T *get(void)
+    {
+        pthread_once(&once, create_key);
+        T *workspace = (T*) pthread_getspecific(key);
+        if (workspace == NULL) {
+            workspace = new T();
+            pthread_setspecific(key, workspace);
+        }
+        return workspace;
+    }
+
+private:
+    static pthread_key_t key;
+    static pthread_once_t once;
+
+    static void create_key(void)
+    {
+        pthread_key_create(&key, destroy);
+    }
+
+    static void destroy(void *workspace)
+    {
+        delete (T*) workspace;
+    }
+};
+
+template <typename T> pthread_key_t threadWorkspace<T>::key;
+template <typename T> pthread_once_t threadWorkspace<T>::once = PTHREAD_ONCE_INIT;
+
+#endif